@@ -0,0 +1,36 @@
+#include "AssetPack.hpp"
+
+#include "read_write_chunk.hpp"
+
+#include <stdexcept>
+
+AssetPack::AssetPack(std::string const &filename) : file(filename) {
+	std::span< char const > bytes = file.bytes();
+
+	std::span< Entry const > entries;
+	std::span< char const > names;
+	map_chunk(&bytes, "idx0", &entries);
+	map_chunk(&bytes, "str0", &names);
+
+	for (auto const &entry : entries) {
+		if (entry.name_begin > entry.name_end || entry.name_end > names.size()) {
+			throw std::runtime_error("Asset pack '" + filename + "' has an entry with a bad name range.");
+		}
+		std::string name(names.data() + entry.name_begin, names.data() + entry.name_end);
+		if (entry.offset > file.size || entry.size > file.size - entry.offset) {
+			throw std::runtime_error("Asset pack '" + filename + "' has '" + name + "' past the end of the file.");
+		}
+		auto ret = assets.emplace(name, file.bytes().subspan(size_t(entry.offset), entry.size));
+		if (!ret.second) {
+			throw std::runtime_error("Asset pack '" + filename + "' has more than one '" + name + "'.");
+		}
+	}
+}
+
+std::span< char const > AssetPack::get(std::string const &name) const {
+	auto f = assets.find(name);
+	if (f == assets.end()) {
+		throw std::runtime_error("Asset pack '" + file.filename + "' has no asset named '" + name + "'.");
+	}
+	return f->second;
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+/*
+ * AssetPack -- many named assets in one file, mapped once and looked up by name.
+ *
+ * A pack is a sequence of chunks (see read_write_chunk.hpp):
+ *  "idx0" -- one Entry per asset (first, so it is aligned for map_chunk)
+ *  "str0" -- the asset names, back-to-back (entries give [begin,end) ranges)
+ *  then each asset's contents as a "dat0" chunk, with "pad0" chunks in between
+ *   so that every asset starts on an Alignment-byte boundary
+ *   (which keeps the chunks inside packed chunk files aligned for map_chunk, too)
+ *
+ * Packs are made at build time by pack-assets (see pack-assets.cpp and Maekfile.js).
+ *
+ */
+
+#include "MappedFile.hpp"
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <unordered_map>
+
+struct AssetPack {
+	struct Entry {
+		uint32_t name_begin = 0; //name is str0[name_begin, name_end)
+		uint32_t name_end = 0;
+		uint64_t offset = 0; //contents are file[offset, offset + size)
+		uint32_t size = 0;
+		uint32_t unused = 0;
+	};
+	static_assert(sizeof(Entry) == 24, "Entry is packed");
+
+	enum : uint32_t {
+		Alignment = 16, //every asset's contents start at a multiple of this offset in the file
+	};
+
+	//map 'filename' and read its index (throws on failure):
+	explicit AssetPack(std::string const &filename);
+
+	//contents of asset 'name' (valid as long as the pack exists; throws if there is no such asset):
+	std::span< char const > get(std::string const &name) const;
+	bool contains(std::string const &name) const { return assets.count(name) != 0; }
+
+	MappedFile file;
+	std::unordered_map< std::string, std::span< char const > > assets;
+};
@@ -0,0 +1,249 @@
+#include "ChunkStream.hpp"
+
+#include <zlib.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+namespace {
+	//same header as read_chunk / write_chunk:
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	struct StreamHeader {
+		char kind[4] = {'b', 'l', 'k', '0'};
+		uint32_t compression = 0;
+		uint32_t block_size = 0;
+		uint32_t block_count = 0;
+		uint64_t raw_size = 0;
+	};
+	static_assert(sizeof(StreamHeader) == 24, "header is packed");
+
+	struct BlockHeader {
+		uint32_t stored_size = 0;
+		uint32_t raw_size = 0;
+		uint32_t crc = 0;
+	};
+	static_assert(sizeof(BlockHeader) == 12, "header is packed");
+
+	//largest block size readers will accept:
+	constexpr uint32_t MaxBlockSize = 16 * 1024 * 1024;
+
+	uint32_t crc_of(std::vector< uint8_t > const &data) {
+		return uint32_t(crc32(crc32(0L, Z_NULL, 0), data.data(), uInt(data.size())));
+	}
+}
+
+//------------------------------------------------------------------
+
+ChunkWriter::ChunkWriter(std::ostream *to_, std::string const &magic_, Compression compression_, uint32_t block_size_)
+	: to(*to_), magic(magic_), compression(compression_), block_size(block_size_) {
+	assert(magic.size() == 4);
+	if (block_size == 0 || block_size > MaxBlockSize) {
+		throw std::runtime_error("Chunk block size must be between 1 and " + std::to_string(MaxBlockSize) + " bytes.");
+	}
+
+	start = to.tellp();
+	if (start == std::streampos(-1)) {
+		throw std::runtime_error("ChunkWriter needs a seekable stream.");
+	}
+
+	//placeholder headers (filled in by finish()):
+	ChunkHeader header;
+	StreamHeader stream_header;
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(&stream_header), sizeof(stream_header));
+	stored_size = sizeof(stream_header);
+
+	block.reserve(block_size);
+}
+
+void ChunkWriter::write(void const *data_, size_t size) {
+	assert(!finished);
+	uint8_t const *data = reinterpret_cast< uint8_t const * >(data_);
+	while (size > 0) {
+		size_t amount = std::min(size, size_t(block_size) - block.size());
+		block.insert(block.end(), data, data + amount);
+		data += amount;
+		size -= amount;
+		if (block.size() == block_size) write_block();
+	}
+}
+
+void ChunkWriter::write_block() {
+	assert(!block.empty());
+
+	std::vector< uint8_t > const *out = &block;
+	if (compression == Zlib) {
+		uLongf compressed_size = compressBound(uLong(block.size()));
+		compressed.resize(compressed_size);
+		if (compress2(compressed.data(), &compressed_size, block.data(), uLong(block.size()), Z_DEFAULT_COMPRESSION) != Z_OK) {
+			throw std::runtime_error("Failed to compress block of chunk '" + magic + "'.");
+		}
+		compressed.resize(compressed_size);
+		//(blocks that don't get smaller are stored as-is; readers tell by stored_size == raw_size)
+		if (compressed.size() < block.size()) out = &compressed;
+	}
+
+	BlockHeader header;
+	header.stored_size = uint32_t(out->size());
+	header.raw_size = uint32_t(block.size());
+	header.crc = crc_of(*out);
+
+	stored_size += sizeof(header) + out->size();
+	if (stored_size > 0xffffffffULL) {
+		throw std::runtime_error("Chunk '" + magic + "' is too large for its 32-bit size.");
+	}
+
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(out->data()), out->size());
+
+	raw_size += block.size();
+	block_count += 1;
+	block.clear();
+}
+
+void ChunkWriter::finish() {
+	assert(!finished);
+	if (!block.empty()) write_block();
+	finished = true;
+
+	ChunkHeader header;
+	std::memcpy(header.magic, magic.data(), 4);
+	header.size = uint32_t(stored_size);
+
+	StreamHeader stream_header;
+	stream_header.compression = compression;
+	stream_header.block_size = block_size;
+	stream_header.block_count = block_count;
+	stream_header.raw_size = raw_size;
+
+	std::streampos end = to.tellp();
+	to.seekp(start);
+	to.write(reinterpret_cast< char const * >(&header), sizeof(header));
+	to.write(reinterpret_cast< char const * >(&stream_header), sizeof(stream_header));
+	to.seekp(end);
+
+	if (!to) {
+		throw std::runtime_error("Failed to write chunk '" + magic + "'.");
+	}
+}
+
+//------------------------------------------------------------------
+
+ChunkReader::ChunkReader(std::istream *from_, std::string const &magic_) : from(*from_), magic(magic_) {
+	ChunkHeader header;
+	if (!from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+	remaining = header.size;
+
+	StreamHeader stream_header;
+	if (remaining < sizeof(stream_header) || !from.read(reinterpret_cast< char * >(&stream_header), sizeof(stream_header))) {
+		throw std::runtime_error("Failed to read stream header of chunk '" + magic + "'");
+	}
+	remaining -= sizeof(stream_header);
+	if (std::string(stream_header.kind,4) != "blk0") {
+		throw std::runtime_error("Chunk '" + magic + "' is not a streamed chunk");
+	}
+	if (stream_header.compression != ChunkWriter::None && stream_header.compression != ChunkWriter::Zlib) {
+		throw std::runtime_error("Chunk '" + magic + "' uses unknown compression " + std::to_string(stream_header.compression));
+	}
+	if (stream_header.block_size == 0 || stream_header.block_size > MaxBlockSize) {
+		throw std::runtime_error("Chunk '" + magic + "' has a bad block size");
+	}
+	//every block but the last is full:
+	uint64_t max_raw_size = uint64_t(stream_header.block_count) * stream_header.block_size;
+	if (stream_header.raw_size > max_raw_size || stream_header.raw_size + stream_header.block_size <= max_raw_size) {
+		throw std::runtime_error("Chunk '" + magic + "' has a size that doesn't match its block count");
+	}
+	if (stream_header.block_count == 0 && remaining != 0) {
+		throw std::runtime_error("Chunk '" + magic + "' has data after its last block");
+	}
+
+	compression = stream_header.compression;
+	block_size = stream_header.block_size;
+	block_count = stream_header.block_count;
+	raw_size = stream_header.raw_size;
+}
+
+bool ChunkReader::next_block(bool decompress) {
+	block.clear();
+	block_at = 0;
+
+	if (blocks_read == block_count) return false;
+
+	BlockHeader header;
+	if (remaining < sizeof(header) || !from.read(reinterpret_cast< char * >(&header), sizeof(header))) {
+		throw std::runtime_error("Failed to read block header in chunk '" + magic + "'");
+	}
+	remaining -= sizeof(header);
+
+	//check sizes before trusting them:
+	bool last = (blocks_read + 1 == block_count);
+	uint32_t expected_raw = uint32_t(last ? raw_size - raw_read : block_size);
+	if (header.raw_size != expected_raw) {
+		throw std::runtime_error("Block in chunk '" + magic + "' has the wrong size");
+	}
+	if (header.stored_size > header.raw_size || header.stored_size > remaining) {
+		throw std::runtime_error("Block in chunk '" + magic + "' has a bad stored size");
+	}
+
+	stored.resize(header.stored_size);
+	if (!from.read(reinterpret_cast< char * >(stored.data()), stored.size())) {
+		throw std::runtime_error("Failed to read block in chunk '" + magic + "'");
+	}
+	remaining -= header.stored_size;
+	if (last && remaining != 0) {
+		throw std::runtime_error("Chunk '" + magic + "' has data after its last block");
+	}
+
+	if (crc_of(stored) != header.crc) {
+		throw std::runtime_error("Block " + std::to_string(blocks_read) + " of chunk '" + magic + "' is corrupt (CRC mismatch)");
+	}
+
+	blocks_read += 1;
+	raw_read += header.raw_size;
+
+	if (!decompress) return true;
+
+	if (header.stored_size == header.raw_size) {
+		block.swap(stored);
+	} else {
+		if (compression != ChunkWriter::Zlib) {
+			throw std::runtime_error("Block in chunk '" + magic + "' is compressed, but the chunk isn't");
+		}
+		block.resize(header.raw_size);
+		uLongf block_length = uLongf(block.size());
+		if (uncompress(block.data(), &block_length, stored.data(), uLong(stored.size())) != Z_OK || block_length != block.size()) {
+			throw std::runtime_error("Failed to decompress block in chunk '" + magic + "'");
+		}
+	}
+	return true;
+}
+
+size_t ChunkReader::read(void *data_, size_t size) {
+	uint8_t *data = reinterpret_cast< uint8_t * >(data_);
+	size_t total = 0;
+	while (total < size) {
+		if (block_at == block.size()) {
+			if (!next_block(true)) break;
+		}
+		size_t amount = std::min(size - total, block.size() - block_at);
+		std::memcpy(data + total, block.data() + block_at, amount);
+		block_at += amount;
+		total += amount;
+	}
+	return total;
+}
+
+void ChunkReader::verify() {
+	while (next_block(false)) { }
+}
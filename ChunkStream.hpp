@@ -0,0 +1,111 @@
+#pragma once
+
+/*
+ * ChunkWriter / ChunkReader -- stream large chunks through a fixed-size buffer,
+ *  optionally zlib-compressed, with a CRC32 on every block.
+ *
+ * A streamed chunk is an ordinary chunk (see read_write_chunk.hpp), so tools that skip
+ *  chunks by header size still work; its contents are:
+ * |bl|k0|..|..| <-- StreamHeader: "blk0", compression, block size, block count, total (uncompressed) size
+ * then, for each block:
+ * |sz|sz|ra|wz|cr|c.| <-- BlockHeader: stored size, raw (uncompressed) size, CRC32 of the stored bytes
+ * |data...| <-- stored bytes (compressed, unless compressing didn't make the block smaller)
+ *
+ * Because the CRCs cover the stored bytes, ChunkReader::verify() can check a whole chunk for
+ *  corruption without decompressing anything.
+ *
+ * All sizes are checked against the chunk's size and block size before anything is allocated,
+ *  so a damaged file throws instead of asking for gigabytes of memory.
+ *
+ */
+
+#include <cstdint>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+struct ChunkWriter {
+	enum Compression : uint32_t {
+		None = 0,
+		Zlib = 1,
+	};
+
+	//start writing a chunk to 'to' (which must be seekable, since the header is filled in by finish()):
+	ChunkWriter(std::ostream *to, std::string const &magic, Compression compression = Zlib, uint32_t block_size = 64 * 1024);
+
+	//append data to the chunk:
+	void write(void const *data, size_t size);
+	template< typename T >
+	void write(std::vector< T > const &from) {
+		write(from.data(), from.size() * sizeof(T));
+	}
+
+	//write the last block and fill in the headers (must be called; throws on failure):
+	void finish();
+
+	//--------------------------------------------------------------
+	//internals:
+
+	std::ostream &to;
+	std::string magic;
+	Compression compression;
+	uint32_t block_size;
+
+	std::streampos start; //where the chunk header was written
+	uint32_t block_count = 0;
+	uint64_t raw_size = 0;
+	uint64_t stored_size = 0; //everything after the chunk header, so far
+	bool finished = false;
+
+	std::vector< uint8_t > block; //data waiting to be written (up to block_size bytes)
+	std::vector< uint8_t > compressed;
+	void write_block();
+};
+
+struct ChunkReader {
+	//start reading a chunk from 'from' (throws if the next chunk isn't a streamed chunk with the given magic):
+	ChunkReader(std::istream *from, std::string const &magic);
+
+	//read up to 'size' bytes of the chunk's (uncompressed) contents; returns the number of bytes read:
+	// (throws if a block is damaged)
+	size_t read(void *data, size_t size);
+
+	//read the whole chunk as an array of T:
+	template< typename T >
+	void read_all(std::vector< T > *to_) {
+		auto &to = *to_;
+		if (raw_size % sizeof(T) != 0) {
+			throw std::runtime_error("Size of chunk not divisible by element size");
+		}
+		to.resize(size_t(raw_size / sizeof(T)));
+		if (read(to.data(), to.size() * sizeof(T)) != to.size() * sizeof(T)) {
+			throw std::runtime_error("Chunk ended early");
+		}
+	}
+
+	//check the CRC of every remaining block, without decompressing (throws if any are damaged):
+	void verify();
+
+	uint64_t raw_size = 0; //total uncompressed size of the chunk's contents
+
+	//--------------------------------------------------------------
+	//internals:
+
+	std::istream &from;
+	std::string magic;
+	uint32_t compression = 0;
+	uint32_t block_size = 0;
+	uint32_t block_count = 0;
+
+	uint64_t remaining = 0; //bytes of the chunk not read yet
+	uint32_t blocks_read = 0;
+	uint64_t raw_read = 0;
+
+	std::vector< uint8_t > stored;
+	std::vector< uint8_t > block;
+	size_t block_at = 0; //next byte of 'block' to hand out
+
+	//read the next block into 'stored' (and, if 'decompress', into 'block'); returns false at the end of the chunk:
+	bool next_block(bool decompress);
+};
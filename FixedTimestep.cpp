@@ -0,0 +1,35 @@
+#include "FixedTimestep.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(float hz, uint32_t max_steps_) : step(1.0f / hz), max_steps(max_steps_) {
+	assert(hz > 0.0f);
+	assert(max_steps > 0);
+}
+
+uint32_t FixedTimestep::advance(float elapsed) {
+	accumulator += std::max(0.0f, elapsed);
+
+	//whole steps owed (the floor() keeps this from getting out of hand after a very long pause):
+	float owed = std::floor(accumulator / step);
+	uint32_t steps = uint32_t(std::min(owed, float(max_steps)));
+	accumulator -= steps * step;
+
+	//past the catch-up limit, drop the whole steps still owed (but keep the fraction, so alpha stays smooth):
+	last_dropped = 0;
+	if (accumulator >= step) {
+		float dropped = std::floor(accumulator / step);
+		accumulator -= dropped * step;
+		last_dropped = uint32_t(std::min(dropped, 4294967295.0f));
+		steps_dropped += last_dropped;
+		frames_dropping += 1;
+	}
+
+	//(floating point rounding can leave the accumulator just outside [0,step) -- keep alpha in [0,1)):
+	accumulator = std::max(0.0f, std::min(accumulator, std::nextafter(step, 0.0f)));
+
+	steps_run += steps;
+	return steps;
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+/*
+ * FixedTimestep -- turns variable frame times into a whole number of fixed-length simulation steps.
+ *
+ * Each frame, feed in the real time that passed and run the number of steps it returns:
+ *   uint32_t steps = timestep.advance(elapsed);
+ *   for (uint32_t s = 0; s < steps; ++s) mode->update(timestep.step);
+ *   mode->draw(drawable_size, timestep.alpha());
+ *
+ * Time that doesn't add up to a whole step is carried over to the next frame;
+ *  alpha() says how far (in [0,1)) the simulation is into the next step, so drawing
+ *  can interpolate between the last two simulated states.
+ *
+ * If the simulation falls too far behind (e.g., the window was dragged, or a step takes
+ *  longer than 'step' to simulate), at most 'max_steps' are run per frame and the rest of the
+ *  backlog is dropped -- the game slows down instead of spiraling. Dropped steps are counted.
+ *
+ */
+
+#include <cstdint>
+
+struct FixedTimestep {
+	explicit FixedTimestep(float hz = 120.0f, uint32_t max_steps = 8);
+
+	float step; //seconds per step
+	uint32_t max_steps; //most steps run in one frame
+
+	//add 'elapsed' seconds of real time; returns how many steps to run now:
+	uint32_t advance(float elapsed);
+
+	//fraction of a step left over after the most recent advance():
+	float alpha() const { return accumulator / step; }
+
+	//--------------------------------------------------------------
+	//telemetry (since construction):
+
+	uint64_t steps_run = 0; //steps handed out by advance()
+	uint64_t steps_dropped = 0; //whole steps skipped because the catch-up limit was hit
+	uint64_t frames_dropping = 0; //frames in which any steps were dropped
+
+	//steps dropped by the most recent advance():
+	uint32_t last_dropped = 0;
+
+	//--------------------------------------------------------------
+	//internals:
+
+	float accumulator = 0.0f; //unsimulated time, in [0, step) after advance()
+};
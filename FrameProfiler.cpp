@@ -0,0 +1,117 @@
+#include "FrameProfiler.hpp"
+
+#include <cassert>
+#include <fstream>
+
+namespace {
+	uint32_t micros(std::chrono::steady_clock::duration d) {
+		return uint32_t(std::chrono::duration_cast< std::chrono::microseconds >(d).count());
+	}
+}
+
+FrameProfiler::FrameProfiler(uint32_t capacity) : slots(capacity), epoch(std::chrono::steady_clock::now()) {
+	assert(capacity > 0);
+}
+
+char const *FrameProfiler::phase_name(uint32_t phase) {
+	switch (phase) {
+		case Events: return "events";
+		case Update: return "update";
+		case Draw: return "draw";
+		case Swap: return "swap";
+	}
+	return "unknown";
+}
+
+void FrameProfiler::begin_frame() {
+	//(a frame that was never ended -- e.g., the loop exited early -- is just dropped)
+	frame_start = std::chrono::steady_clock::now();
+	pending = Frame();
+	pending.index = recorded.load(std::memory_order_relaxed);
+	pending.start_us = std::chrono::duration_cast< std::chrono::microseconds >(frame_start - epoch).count();
+	in_frame = true;
+}
+
+void FrameProfiler::begin(Phase phase) {
+	if (!in_frame) return;
+	phase_start[phase] = std::chrono::steady_clock::now();
+	pending.phase_start_us[phase] = micros(phase_start[phase] - frame_start);
+}
+
+void FrameProfiler::end(Phase phase) {
+	if (!in_frame) return;
+	pending.phase_us[phase] = micros(std::chrono::steady_clock::now() - phase_start[phase]);
+}
+
+void FrameProfiler::end_frame() {
+	if (!in_frame) return;
+	in_frame = false;
+	pending.frame_us = micros(std::chrono::steady_clock::now() - frame_start);
+
+	Slot &slot = slots[pending.index % slots.size()];
+
+	//mark the slot as being written (readers that see an odd -- or changed -- sequence will retry or give up):
+	slot.sequence.store(2 * pending.index + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+
+	slot.start_us.store(pending.start_us, std::memory_order_relaxed);
+	slot.frame_us.store(pending.frame_us, std::memory_order_relaxed);
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		slot.phase_start_us[p].store(pending.phase_start_us[p], std::memory_order_relaxed);
+		slot.phase_us[p].store(pending.phase_us[p], std::memory_order_relaxed);
+	}
+
+	slot.sequence.store(2 * pending.index + 2, std::memory_order_release);
+	recorded.store(pending.index + 1, std::memory_order_release);
+}
+
+bool FrameProfiler::read_frame(uint64_t index, Frame *frame) const {
+	assert(frame);
+	Slot const &slot = slots[index % slots.size()];
+
+	uint64_t before = slot.sequence.load(std::memory_order_acquire);
+	if (before != 2 * index + 2) return false; //not written yet, being written, or holds some other frame
+
+	frame->index = index;
+	frame->start_us = slot.start_us.load(std::memory_order_relaxed);
+	frame->frame_us = slot.frame_us.load(std::memory_order_relaxed);
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		frame->phase_start_us[p] = slot.phase_start_us[p].load(std::memory_order_relaxed);
+		frame->phase_us[p] = slot.phase_us[p].load(std::memory_order_relaxed);
+	}
+
+	//if the writer got to this slot while we were reading, the copy may be torn:
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.sequence.load(std::memory_order_relaxed) == before;
+}
+
+bool FrameProfiler::write_trace(std::string const &filename) const {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+
+	//trace-event format: "X" events are complete events with a start ("ts") and duration ("dur"), both in microseconds:
+	auto event = [&out](char const *name, uint64_t ts, uint32_t dur, uint64_t frame, bool first) {
+		out << (first ? "\n" : ",\n")
+		    << "{\"name\":\"" << name << "\",\"cat\":\"frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1"
+		    << ",\"ts\":" << ts << ",\"dur\":" << dur
+		    << ",\"args\":{\"frame\":" << frame << "}}";
+	};
+
+	out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+	uint64_t end = frames_recorded();
+	uint64_t begin = (end > slots.size() ? end - slots.size() : 0);
+	bool first = true;
+	for (uint64_t i = begin; i < end; ++i) {
+		Frame f;
+		if (!read_frame(i, &f)) continue;
+		event("frame", f.start_us, f.frame_us, f.index, first);
+		first = false;
+		for (uint32_t p = 0; p < PhaseCount; ++p) {
+			if (f.phase_us[p] == 0) continue;
+			event(phase_name(p), f.start_us + f.phase_start_us[p], f.phase_us[p], f.index, false);
+		}
+	}
+	out << "\n]}\n";
+
+	return bool(out);
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+/*
+ * FrameProfiler -- records how long each part of the main loop takes.
+ *
+ * The main loop brackets its phases with Scopes:
+ *   profiler.begin_frame();
+ *   { FrameProfiler::Scope scope(profiler, FrameProfiler::Events); ...poll events... }
+ *   { FrameProfiler::Scope scope(profiler, FrameProfiler::Update); ...update... }
+ *   ...
+ *   profiler.end_frame();
+ *
+ * Finished frames go into a fixed-size ring buffer. Only one thread may record frames,
+ *  but any thread may read them (with read_frame()) at any time without locking:
+ *  each slot carries a sequence number, so a reader can tell if the slot was overwritten
+ *  while it was being read (in which case read_frame() just returns false).
+ *
+ * write_trace() saves the recorded frames in Chrome's trace-event format,
+ *  which can be opened with chrome://tracing or https://ui.perfetto.dev
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct FrameProfiler {
+	//keeps the most recent 'capacity' frames:
+	explicit FrameProfiler(uint32_t capacity = 1024);
+
+	FrameProfiler(FrameProfiler const &) = delete;
+	FrameProfiler &operator=(FrameProfiler const &) = delete;
+
+	//the parts of the main loop that are timed:
+	enum Phase : uint32_t {
+		Events, //polling + handling events
+		Update, //Mode::update
+		Draw, //Mode::draw
+		Swap, //SDL_GL_SwapWindow (usually includes waiting for vsync)
+		PhaseCount
+	};
+	static char const *phase_name(uint32_t phase);
+
+	struct Frame {
+		uint64_t index = 0; //number of frames recorded before this one
+		uint64_t start_us = 0; //when begin_frame() was called (microseconds since the profiler was created)
+		uint32_t frame_us = 0; //from begin_frame() to end_frame()
+		std::array< uint32_t, PhaseCount > phase_start_us{}; //when each phase started (relative to start_us)
+		std::array< uint32_t, PhaseCount > phase_us{}; //how long each phase took (0 if it didn't happen)
+	};
+
+	//--------------------------------------------------------------
+	//recording (from one thread only):
+
+	void begin_frame();
+	void begin(Phase phase);
+	void end(Phase phase);
+	void end_frame();
+
+	//times a phase for as long as it is in scope (so early 'break's still get recorded):
+	struct Scope {
+		Scope(FrameProfiler &profiler_, Phase phase_) : profiler(profiler_), phase(phase_) { profiler.begin(phase); }
+		~Scope() { profiler.end(phase); }
+		Scope(Scope const &) = delete;
+		Scope &operator=(Scope const &) = delete;
+		FrameProfiler &profiler;
+		Phase phase;
+	};
+
+	//--------------------------------------------------------------
+	//reading (from any thread):
+
+	uint32_t capacity() const { return uint32_t(slots.size()); }
+
+	//number of frames recorded so far; frames [max(count,capacity)-capacity, count) may still be in the ring:
+	uint64_t frames_recorded() const { return recorded.load(std::memory_order_acquire); }
+
+	//copy frame 'index' into *frame; returns false if it isn't (or is no longer) in the ring:
+	bool read_frame(uint64_t index, Frame *frame) const;
+
+	//write every frame still in the ring as Chrome trace-event JSON; returns false on failure:
+	bool write_trace(std::string const &filename) const;
+
+	//--------------------------------------------------------------
+	//internals:
+
+	//a ring buffer slot ("seqlock": sequence is odd while the slot is being written):
+	struct Slot {
+		std::atomic< uint64_t > sequence{0}; //2 * (index + 1) once frame 'index' is stored
+		std::atomic< uint64_t > start_us{0};
+		std::atomic< uint32_t > frame_us{0};
+		std::array< std::atomic< uint32_t >, PhaseCount > phase_start_us{};
+		std::array< std::atomic< uint32_t >, PhaseCount > phase_us{};
+	};
+	std::vector< Slot > slots;
+	std::atomic< uint64_t > recorded{0};
+
+	//frame being recorded (only touched by the recording thread):
+	std::chrono::steady_clock::time_point epoch;
+	std::chrono::steady_clock::time_point frame_start;
+	std::array< std::chrono::steady_clock::time_point, PhaseCount > phase_start;
+	Frame pending;
+	bool in_frame = false;
+};
@@ -0,0 +1,228 @@
+#include "FrameProfilerOverlay.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+namespace {
+	//tile table layout:
+	// tile 0 is always blank; tiles [1,LineTile) are built each frame from the rasterized overlay
+	constexpr uint8_t LineTile = 255;
+
+	//palette table layout:
+	enum : uint8_t {
+		GraphPalette = 0,
+		TextPalette = 1,
+		LegendPalette = 2, //(+ phase)
+		LinePalette = 5,
+		ClearPalette = 7,
+	};
+
+	//colors for each stacked segment of a bar:
+	glm::u8vec4 const Backdrop = glm::u8vec4(0x00, 0x00, 0x00, 0xa0);
+	std::array< glm::u8vec4, 3 > const SegmentColors = {
+		glm::u8vec4(0x44, 0xcc, 0x44, 0xff), //events + update
+		glm::u8vec4(0x44, 0x88, 0xff, 0xff), //draw
+		glm::u8vec4(0x88, 0x88, 0x88, 0xff), //swap
+	};
+
+	//3x5 font, rows top-to-bottom:
+	struct Glyph {
+		char c;
+		char const *rows[5];
+	};
+	Glyph const Font[] = {
+		{'0', {"###", "#.#", "#.#", "#.#", "###"}},
+		{'1', {".#.", "##.", ".#.", ".#.", "###"}},
+		{'2', {"###", "..#", "###", "#..", "###"}},
+		{'3', {"###", "..#", "###", "..#", "###"}},
+		{'4', {"#.#", "#.#", "###", "..#", "..#"}},
+		{'5', {"###", "#..", "###", "..#", "###"}},
+		{'6', {"###", "#..", "###", "#.#", "###"}},
+		{'7', {"###", "..#", "..#", ".#.", ".#."}},
+		{'8', {"###", "#.#", "###", "#.#", "###"}},
+		{'9', {"###", "#.#", "###", "..#", "###"}},
+		{'.', {"...", "...", "...", "...", ".#."}},
+		{'A', {".#.", "#.#", "###", "#.#", "#.#"}},
+		{'D', {"##.", "#.#", "#.#", "#.#", "##."}},
+		{'G', {"###", "#..", "#.#", "#.#", "###"}},
+		{'M', {"#.#", "###", "###", "#.#", "#.#"}},
+		{'P', {"###", "#.#", "###", "#..", "#.."}},
+		{'R', {"##.", "#.#", "##.", "#.#", "#.#"}},
+		{'S', {"###", "#..", "###", "..#", "###"}},
+		{'U', {"#.#", "#.#", "#.#", "#.#", "###"}},
+		{'V', {"#.#", "#.#", "#.#", "#.#", ".#."}},
+		{'W', {"#.#", "#.#", "###", "###", "#.#"}},
+		{'X', {"#.#", "#.#", ".#.", "#.#", "#.#"}},
+	};
+
+	//legend entries (placed at even character columns, so each starts on a tile boundary):
+	struct Legend {
+		uint32_t column;
+		char const *label;
+	};
+	std::array< Legend, 3 > const Legends = {
+		Legend{40, "UPD"},
+		Legend{48, "DRAW"},
+		Legend{56, "SWAP"},
+	};
+}
+
+FrameProfilerOverlay::FrameProfilerOverlay() {
+	ppu.clear_screen = false;
+
+	//palettes:
+	for (auto &palette : ppu.palette_table) {
+		palette.fill(glm::u8vec4(0x00, 0x00, 0x00, 0x00));
+	}
+	ppu.palette_table[GraphPalette] = PPU466::Palette{ Backdrop, SegmentColors[0], SegmentColors[1], SegmentColors[2] };
+	ppu.palette_table[TextPalette] = PPU466::Palette{ Backdrop, glm::u8vec4(0xff), glm::u8vec4(0xff), glm::u8vec4(0xff) };
+	for (uint32_t i = 0; i < SegmentColors.size(); ++i) {
+		ppu.palette_table[LegendPalette + i] = PPU466::Palette{ Backdrop, SegmentColors[i], SegmentColors[i], SegmentColors[i] };
+	}
+	ppu.palette_table[LinePalette][1] = glm::u8vec4(0xff, 0xee, 0x44, 0xff);
+
+	//tiles:
+	for (auto &tile : ppu.tile_table) {
+		tile.bit0.fill(0);
+		tile.bit1.fill(0);
+	}
+	ppu.tile_table[LineTile].bit0[0] = 0x33; //dashed line along the bottom row
+
+	//everything outside the overlay is transparent:
+	for (auto &entry : ppu.background) {
+		entry = uint16_t(ClearPalette << 8);
+	}
+
+	//the 60Hz line is placed in draw() (since it depends on ms_per_pixel):
+	for (auto &sprite : ppu.sprites) {
+		sprite = PPU466::Sprite();
+	}
+}
+
+void FrameProfilerOverlay::text(uint32_t column, std::string const &str) {
+	for (char c : str) {
+		Glyph const *glyph = nullptr;
+		for (auto const &g : Font) {
+			if (g.c == c) glyph = &g;
+		}
+		if (glyph) {
+			//glyph rows go (top-to-bottom) into rows 6 through 2 of the text row's tiles:
+			for (uint32_t r = 0; r < 5; ++r) {
+				uint32_t y = TextRow * 8 + 6 - r;
+				for (uint32_t x = 0; x < 3; ++x) {
+					if (glyph->rows[r][x] == '#') {
+						pixels[y * PPU466::ScreenWidth + column * CharWidth + x] = 1;
+					}
+				}
+			}
+		}
+		column += 1;
+		if (column * CharWidth >= PPU466::ScreenWidth) break;
+	}
+}
+
+void FrameProfilerOverlay::draw(FrameProfiler const &profiler, glm::uvec2 const &drawable_size) {
+	pixels.fill(0);
+
+	//bars, most recent frame on the right:
+	uint64_t end = profiler.frames_recorded();
+	float us_per_pixel = ms_per_pixel * 1000.0f;
+	float total_ms = 0.0f;
+	float max_ms = 0.0f;
+	uint32_t frames = 0;
+	for (uint32_t b = 0; b < BarCount; ++b) {
+		uint64_t age = BarCount - b; //(1 is the most recent frame)
+		if (age > end) continue;
+		FrameProfiler::Frame frame;
+		if (!profiler.read_frame(end - age, &frame)) continue;
+
+		total_ms += frame.frame_us / 1000.0f;
+		max_ms = std::max(max_ms, frame.frame_us / 1000.0f);
+		frames += 1;
+
+		//stack phases from the bottom:
+		std::array< uint32_t, 3 > segments = {
+			frame.phase_us[FrameProfiler::Events] + frame.phase_us[FrameProfiler::Update],
+			frame.phase_us[FrameProfiler::Draw],
+			frame.phase_us[FrameProfiler::Swap],
+		};
+		uint32_t top_us = 0;
+		uint32_t y = 0;
+		for (uint32_t s = 0; s < segments.size(); ++s) {
+			top_us += segments[s];
+			uint32_t top = std::min< uint32_t >(GraphRows * 8, uint32_t(std::round(top_us / us_per_pixel)));
+			for (; y < top; ++y) {
+				for (uint32_t x = 0; x < BarWidth - 1; ++x) { //(leave a gap between bars)
+					pixels[y * PPU466::ScreenWidth + b * BarWidth + x] = uint8_t(1 + s);
+				}
+			}
+		}
+	}
+
+	//labels:
+	if (frames > 0) {
+		char buffer[64];
+		std::snprintf(buffer, sizeof(buffer), "AVG %.1fMS MAX %.1fMS", total_ms / frames, max_ms);
+		text(0, buffer);
+	}
+	for (auto const &legend : Legends) {
+		text(legend.column, legend.label);
+	}
+
+	//cut the image into tiles, sharing identical ones:
+	tile_lookup.clear();
+	tile_lookup.emplace(std::make_pair(ppu.tile_table[0].bit0, ppu.tile_table[0].bit1), uint8_t(0));
+	uint32_t next_tile = 1;
+	for (uint32_t row = 0; row < Rows; ++row) {
+		for (uint32_t col = 0; col < PPU466::ScreenWidth / 8; ++col) {
+			PPU466::Tile tile;
+			for (uint32_t y = 0; y < 8; ++y) {
+				uint8_t const *src = &pixels[(row * 8 + y) * PPU466::ScreenWidth + col * 8];
+				tile.bit0[y] = 0;
+				tile.bit1[y] = 0;
+				for (uint32_t x = 0; x < 8; ++x) {
+					tile.bit0[y] |= uint8_t((src[x] & 1) << x);
+					tile.bit1[y] |= uint8_t(((src[x] >> 1) & 1) << x);
+				}
+			}
+
+			uint8_t index = 0;
+			auto key = std::make_pair(tile.bit0, tile.bit1);
+			auto f = tile_lookup.find(key);
+			if (f != tile_lookup.end()) {
+				index = f->second;
+			} else if (next_tile < LineTile) {
+				index = uint8_t(next_tile++);
+				ppu.tile_table[index] = tile;
+				tile_lookup.emplace(key, index);
+			} //else out of tiles, so leave this one blank
+
+			uint8_t palette = (row == TextRow ? TextPalette : GraphPalette);
+			if (row == TextRow) {
+				for (uint32_t i = 0; i < Legends.size(); ++i) {
+					uint32_t begin = Legends[i].column * CharWidth / 8;
+					uint32_t end = begin + (uint32_t(std::string(Legends[i].label).size()) * CharWidth + 7) / 8;
+					if (col >= begin && col < end) palette = uint8_t(LegendPalette + i);
+				}
+			}
+			ppu.background[(FirstRow + row) * PPU466::BackgroundWidth + col] = uint16_t((palette << 8) | index);
+		}
+	}
+
+	//dashed line of sprites at 1/60th of a second:
+	uint32_t line = uint32_t(std::round(1000.0f / 60.0f / ms_per_pixel));
+	for (uint32_t i = 0; i < ppu.sprites.size(); ++i) {
+		PPU466::Sprite &sprite = ppu.sprites[i];
+		if (i * 8 < PPU466::ScreenWidth && line < GraphRows * 8) {
+			sprite.x = uint8_t(i * 8);
+			sprite.y = uint8_t(FirstRow * 8 + line);
+			sprite.index = LineTile;
+			sprite.attributes = LinePalette;
+		} else {
+			sprite = PPU466::Sprite();
+		}
+	}
+
+	ppu.draw(drawable_size);
+}
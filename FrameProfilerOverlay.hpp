@@ -0,0 +1,55 @@
+#pragma once
+
+/*
+ * FrameProfilerOverlay -- draws a frame-time graph from a FrameProfiler over the current framebuffer.
+ *
+ * The graph is drawn with its own PPU466 (so it gets the same pixel-art look as the game):
+ *  - each recent frame is a bar, stacked by phase (events + update, draw, swap);
+ *  - a line of sprites marks 1/60th of a second;
+ *  - a line of text gives the average and maximum frame time.
+ *
+ * The bars are rasterized every frame and then cut into (deduplicated) tiles for the PPU's tile table.
+ * (the overlay's PPU466 keeps its own copy of its tables on the GPU, so showing it doesn't make the game's PPU re-upload anything)
+ *
+ */
+
+#include "FrameProfiler.hpp"
+#include "PPU466.hpp"
+
+#include <map>
+#include <string>
+#include <utility>
+
+struct FrameProfilerOverlay {
+	FrameProfilerOverlay();
+
+	//build the graph from the most recent frames in 'profiler' and draw it (without clearing the screen):
+	void draw(FrameProfiler const &profiler, glm::uvec2 const &drawable_size);
+
+	//vertical scale of the graph:
+	float ms_per_pixel = 0.5f;
+
+	//--------------------------------------------------------------
+	//internals:
+
+	enum : uint32_t {
+		BarWidth = 2, //pixels
+		BarCount = PPU466::ScreenWidth / BarWidth,
+		GraphRows = 8, //tiles
+		TextRow = GraphRows, //(text goes just above the graph)
+		Rows = GraphRows + 1,
+		FirstRow = 30 - Rows, //graph is at the top of the screen
+		CharWidth = 4, //pixels (so two characters per tile)
+	};
+
+	PPU466 ppu;
+
+	//overlay contents as a color-index image (Rows * 8 pixels tall, rows bottom-to-top):
+	std::array< uint8_t, uint32_t(PPU466::ScreenWidth) * Rows * 8 > pixels;
+
+	//write text into 'pixels' at character column 'column' of the text row:
+	void text(uint32_t column, std::string const &str);
+
+	//map from tile contents to tile table index (used to share identical tiles):
+	std::map< std::pair< std::array< uint8_t, 8 >, std::array< uint8_t, 8 > >, uint8_t > tile_lookup;
+};
@@ -0,0 +1,76 @@
+#include "InputLog.hpp"
+
+#include "read_write_chunk.hpp"
+#include "ChunkStream.hpp"
+
+#include <fstream>
+#include <stdexcept>
+
+InputLog::Event InputLog::from_sdl(SDL_Event const &evt, glm::uvec2 const &window_size, uint32_t step) {
+	Event event;
+	event.step = step;
+	event.type = evt.type;
+	event.window_size = glm::u16vec2(window_size);
+	if (evt.type == SDL_EVENT_KEY_DOWN || evt.type == SDL_EVENT_KEY_UP) {
+		event.key = evt.key.key;
+		event.down = evt.key.down;
+		event.repeat = evt.key.repeat;
+	} else if (evt.type == SDL_EVENT_MOUSE_MOTION) {
+		event.position = glm::vec2(evt.motion.x, evt.motion.y);
+	} else if (evt.type == SDL_EVENT_MOUSE_BUTTON_DOWN || evt.type == SDL_EVENT_MOUSE_BUTTON_UP) {
+		event.button = evt.button.button;
+		event.down = evt.button.down;
+		event.position = glm::vec2(evt.button.x, evt.button.y);
+	}
+	return event;
+}
+
+SDL_Event InputLog::to_sdl(Event const &event) {
+	SDL_Event evt;
+	SDL_zero(evt);
+	evt.type = event.type;
+	if (evt.type == SDL_EVENT_KEY_DOWN || evt.type == SDL_EVENT_KEY_UP) {
+		evt.key.key = event.key;
+		evt.key.down = (event.down != 0);
+		evt.key.repeat = (event.repeat != 0);
+	} else if (evt.type == SDL_EVENT_MOUSE_MOTION) {
+		evt.motion.x = event.position.x;
+		evt.motion.y = event.position.y;
+	} else if (evt.type == SDL_EVENT_MOUSE_BUTTON_DOWN || evt.type == SDL_EVENT_MOUSE_BUTTON_UP) {
+		evt.button.button = event.button;
+		evt.button.down = (event.down != 0);
+		evt.button.x = event.position.x;
+		evt.button.y = event.position.y;
+	}
+	return evt;
+}
+
+void InputLog::load(std::string const &filename) {
+	std::ifstream file(filename, std::ios::binary);
+	if (!file) throw std::runtime_error("Failed to open input log '" + filename + "'.");
+
+	std::vector< Info > infos;
+	read_chunk(file, "inpi", &infos);
+	if (infos.size() != 1) throw std::runtime_error("Input log '" + filename + "' should have exactly one info record.");
+	if (!(infos[0].step > 0.0f)) throw std::runtime_error("Input log '" + filename + "' has a bad step length.");
+
+	std::vector< Event > new_events;
+	ChunkReader(&file, "inpt").read_all(&new_events);
+	for (size_t i = 0; i < new_events.size(); ++i) {
+		if (new_events[i].step > infos[0].steps || (i > 0 && new_events[i].step < new_events[i-1].step)) {
+			throw std::runtime_error("Input log '" + filename + "' has events out of order.");
+		}
+	}
+
+	info = infos[0];
+	events = std::move(new_events);
+}
+
+void InputLog::save(std::string const &filename) const {
+	std::ofstream file(filename, std::ios::binary);
+	write_chunk("inpi", std::vector< Info >{ info }, &file);
+	ChunkWriter writer(&file, "inpt");
+	writer.write(events);
+	writer.finish();
+	if (!file) throw std::runtime_error("Failed to write input log '" + filename + "'.");
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+/*
+ * InputLog -- a recording of the events a Mode was given, for replaying a play session exactly.
+ *
+ * Events are tagged with the simulation step they arrived before. Since Mode::update runs at a
+ *  fixed rate (see FixedTimestep.hpp), giving a fresh Mode the same events before the same steps
+ *  reproduces the session no matter how fast (or slowly) the replay is drawn.
+ *
+ * Files are two chunks (see read_write_chunk.hpp):
+ *  "inpi" -- one Info (step length and session length)
+ *  "inpt" -- the Events, in order (zlib-compressed; see ChunkStream.hpp)
+ *
+ */
+
+#include <SDL3/SDL.h>
+#include <glm/glm.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct InputLog {
+	struct Info {
+		float step = 0.0f; //seconds per simulation step
+		uint32_t steps = 0; //steps in the whole session
+	};
+	static_assert(sizeof(Info) == 8, "Info is packed");
+
+	struct Event {
+		uint32_t step = 0; //number of steps run before the event was handled
+		uint32_t type = 0; //SDL event type
+		uint32_t key = 0; //keycode (key events)
+		uint8_t down = 0; //key or button is down (key + mouse button events)
+		uint8_t repeat = 0; //key repeat (key events)
+		uint8_t button = 0; //mouse button (mouse button events)
+		uint8_t unused = 0;
+		glm::vec2 position = glm::vec2(0.0f); //mouse position (mouse events)
+		glm::u16vec2 window_size = glm::u16vec2(0); //window size passed to handle_event
+	};
+	static_assert(sizeof(Event) == 28, "Event is packed");
+
+	Info info;
+	std::vector< Event > events;
+
+	//convert to / from SDL events (fields not listed above are zero):
+	static Event from_sdl(SDL_Event const &evt, glm::uvec2 const &window_size, uint32_t step);
+	static SDL_Event to_sdl(Event const &event);
+
+	//read / write files (throw on failure):
+	void load(std::string const &filename);
+	void save(std::string const &filename) const;
+};
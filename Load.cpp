@@ -1,20 +1,190 @@
 #include "Load.hpp"
 
+#include <algorithm>
 #include <array>
-#include <list>
+#include <atomic>
 #include <cassert>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace {
-	std::array< std::list< std::function< void() > >, MaxLoadTag > &get_load_lists() {
-		static std::array< std::list< std::function< void() > >, MaxLoadTag > load_lists;
-		return load_lists;
+	std::vector< LoadFunction > &get_load_functions() {
+		static std::vector< LoadFunction > load_functions;
+		return load_functions;
 	}
+
+	//Loads (plus one 'barrier' per tag, so tags don't need an edge from every load to every later load) as a graph:
+	struct LoadGraph {
+		struct Node {
+			LoadFunction const *fn = nullptr; //(nullptr for barriers)
+			std::string name; //for error messages
+			std::vector< size_t > depends; //nodes this one waits for
+			std::vector< size_t > dependents; //nodes waiting for this one
+		};
+		std::vector< Node > nodes;
+
+		LoadGraph(std::vector< LoadFunction > const &functions) {
+			//barriers[t] is done once every load with a tag before t is done:
+			static std::array< char const *, MaxLoadTag > const TagNames = { "LoadTagEarly", "LoadTagDefault", "LoadTagLate" };
+			std::array< size_t, MaxLoadTag > barriers;
+			for (uint32_t t = 0; t < MaxLoadTag; ++t) {
+				barriers[t] = nodes.size();
+				nodes.emplace_back();
+				nodes.back().name = std::string("(start of ") + TagNames[t] + ")";
+				if (t > 0) add_edge(barriers[t-1], barriers[t]);
+			}
+
+			std::unordered_map< void const *, size_t > by_key;
+			for (auto const &fn : functions) {
+				size_t index = nodes.size();
+				nodes.emplace_back();
+				nodes.back().fn = &fn;
+				nodes.back().name = std::string(fn.location.file_name()) + ":" + std::to_string(fn.location.line());
+				if (fn.key) by_key.emplace(fn.key, index);
+			}
+
+			for (size_t index = MaxLoadTag; index < nodes.size(); ++index) {
+				LoadFunction const &fn = *nodes[index].fn;
+				assert(fn.tag < MaxLoadTag);
+				if (fn.after_tag) {
+					add_edge(barriers[fn.tag], index);
+					if (fn.tag + 1 < MaxLoadTag) add_edge(index, barriers[fn.tag + 1]);
+				}
+				for (void const *key : fn.depends) {
+					auto f = by_key.find(key);
+					if (f == by_key.end()) {
+						throw std::runtime_error("Load declared at " + nodes[index].name + " comes after a Load<> that was never constructed.");
+					}
+					add_edge(f->second, index);
+				}
+			}
+
+			check_for_cycles();
+		}
+
+		void add_edge(size_t from, size_t to) {
+			nodes[to].depends.emplace_back(from);
+			nodes[from].dependents.emplace_back(to);
+		}
+
+		//Kahn's algorithm; anything left over is in (or waiting on) a cycle:
+		void check_for_cycles() const {
+			std::vector< size_t > waiting(nodes.size());
+			std::vector< size_t > ready;
+			for (size_t i = 0; i < nodes.size(); ++i) {
+				waiting[i] = nodes[i].depends.size();
+				if (waiting[i] == 0) ready.emplace_back(i);
+			}
+			size_t processed = 0;
+			while (!ready.empty()) {
+				size_t i = ready.back();
+				ready.pop_back();
+				processed += 1;
+				for (size_t d : nodes[i].dependents) {
+					if (--waiting[d] == 0) ready.emplace_back(d);
+				}
+			}
+			if (processed == nodes.size()) return;
+
+			//walk back along unfinished dependencies until a node repeats -- that's the cycle:
+			size_t at = 0;
+			while (waiting[at] == 0) ++at;
+			std::vector< size_t > path;
+			std::vector< size_t > seen_at(nodes.size(), size_t(-1));
+			while (seen_at[at] == size_t(-1)) {
+				seen_at[at] = path.size();
+				path.emplace_back(at);
+				for (size_t d : nodes[at].depends) {
+					if (waiting[d] != 0) {
+						at = d;
+						break;
+					}
+				}
+			}
+			std::string message = "Load<>s depend on each other in a cycle (each waits for the next): ";
+			for (size_t p = seen_at[at]; p < path.size(); ++p) {
+				message += nodes[path[p]].name + " -> ";
+			}
+			message += nodes[at].name;
+			throw std::runtime_error(message);
+		}
+	};
+}
+
+void add_load_function(LoadFunction const &fn) {
+	assert(fn.tag < MaxLoadTag);
+	get_load_functions().emplace_back(fn);
 }
 
 void add_load_function(LoadTag tag, std::function< void() > const &fn) {
-	auto &load_lists = get_load_lists();
-	assert(tag < load_lists.size());
-	load_lists[tag].emplace_back(fn);
+	LoadFunction load;
+	load.tag = tag;
+	load.work = fn;
+	add_load_function(load);
+}
+
+void add_threaded_load_function(LoadTag tag, std::function< void() > const &work_fn, std::function< void() > const &finish_fn) {
+	LoadFunction load;
+	load.tag = tag;
+	load.threaded = true;
+	load.work = work_fn;
+	load.finish = finish_fn;
+	add_load_function(load);
+}
+
+namespace {
+	//runs prefetch functions, one at a time, on a thread of its own:
+	struct PrefetchThread {
+		PrefetchThread() : thread([this](){ run(); }) { }
+		~PrefetchThread() {
+			{ //(anything not started yet is dropped -- the program is exiting)
+				std::unique_lock< std::mutex > lock(mutex);
+				quit = true;
+				functions.clear();
+			}
+			wake.notify_all();
+			thread.join();
+		}
+
+		void add(std::function< void() > const &fn) {
+			std::unique_lock< std::mutex > lock(mutex);
+			functions.emplace_back(fn);
+			wake.notify_one();
+		}
+
+		std::mutex mutex;
+		std::condition_variable wake;
+		std::deque< std::function< void() > > functions;
+		bool quit = false;
+		std::thread thread;
+
+		void run() {
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				wake.wait(lock, [this](){ return quit || !functions.empty(); });
+				if (quit) return;
+				std::function< void() > fn = std::move(functions.front());
+				functions.pop_front();
+				lock.unlock();
+				fn(); //(LazyLoad's prefetch functions catch their own exceptions)
+				lock.lock();
+			}
+		}
+	};
+}
+
+void add_prefetch_function(std::function< void() > const &fn) {
+	//(started on first use, so it is destroyed -- and joined -- before any global LazyLoad<>s are)
+	static PrefetchThread prefetch_thread;
+	prefetch_thread.add(fn);
 }
 
 void call_load_functions() {
@@ -22,11 +192,120 @@ void call_load_functions() {
 	assert(!has_been_called && "call_load_functions should only be called *once*");
 	has_been_called = true;
 
-	auto &load_lists = get_load_lists();
-	for (auto &fn_list : load_lists) {
-		while (!fn_list.empty()) {
-			(*fn_list.begin())(); //call first function in the list
-			fn_list.pop_front(); //remove from list
+	std::vector< LoadFunction > functions;
+	functions.swap(get_load_functions());
+	LoadGraph graph(functions); //(throws on cycles)
+	auto &nodes = graph.nodes;
+
+	std::vector< size_t > waiting(nodes.size());
+	for (size_t i = 0; i < nodes.size(); ++i) {
+		waiting[i] = nodes[i].depends.size();
+	}
+
+	//main-thread loads that are ready, run in the order they were declared:
+	std::priority_queue< size_t, std::vector< size_t >, std::greater< size_t > > main_ready;
+
+	//threaded loads that are ready (taken by workers) and done (taken by the main thread):
+	std::mutex mutex;
+	std::condition_variable work_cv, done_cv;
+	std::deque< size_t > work;
+	std::deque< std::pair< size_t, std::exception_ptr > > done;
+	bool stop = false;
+
+	size_t threaded_count = std::count_if(functions.begin(), functions.end(), [](LoadFunction const &fn){ return fn.threaded; });
+	std::vector< std::thread > workers;
+	uint32_t worker_count = std::max(1U, std::thread::hardware_concurrency());
+	worker_count = uint32_t(std::min< size_t >(worker_count, threaded_count));
+	for (uint32_t i = 0; i < worker_count; ++i) {
+		workers.emplace_back([&](){
+			std::unique_lock< std::mutex > lock(mutex);
+			while (true) {
+				work_cv.wait(lock, [&](){ return stop || !work.empty(); });
+				if (stop) return;
+				size_t index = work.front();
+				work.pop_front();
+				lock.unlock();
+
+				std::exception_ptr error;
+				try {
+					nodes[index].fn->work();
+				} catch (...) {
+					error = std::current_exception();
+				}
+
+				lock.lock();
+				done.emplace_back(index, error);
+				done_cv.notify_one();
+			}
+		});
+	}
+
+	auto make_ready = [&](size_t index) {
+		if (nodes[index].fn && nodes[index].fn->threaded) {
+			std::unique_lock< std::mutex > lock(mutex);
+			work.emplace_back(index);
+			work_cv.notify_one();
+		} else {
+			main_ready.emplace(index);
 		}
+	};
+
+	size_t completed = 0;
+	auto complete = [&](size_t index) {
+		completed += 1;
+		for (size_t d : nodes[index].dependents) {
+			if (--waiting[d] == 0) make_ready(d);
+		}
+	};
+
+	try {
+		for (size_t i = 0; i < nodes.size(); ++i) {
+			if (waiting[i] == 0) make_ready(i);
+		}
+
+		while (completed < nodes.size()) {
+			//finish any threaded loads that are done:
+			std::deque< std::pair< size_t, std::exception_ptr > > finished;
+			{
+				std::unique_lock< std::mutex > lock(mutex);
+				if (main_ready.empty()) {
+					done_cv.wait(lock, [&](){ return !done.empty(); });
+				}
+				finished.swap(done);
+			}
+			for (auto const &[index, error] : finished) {
+				if (error) std::rethrow_exception(error);
+				if (nodes[index].fn->finish) nodes[index].fn->finish();
+				complete(index);
+			}
+
+			//run the next main-thread load:
+			if (!main_ready.empty()) {
+				size_t index = main_ready.top();
+				main_ready.pop();
+				if (nodes[index].fn) nodes[index].fn->work();
+				complete(index);
+			}
+		}
+	} catch (...) {
+		//(workers must be joined before anything is rethrown)
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			stop = true;
+		}
+		work_cv.notify_all();
+		for (auto &worker : workers) {
+			worker.join();
+		}
+		throw;
+	}
+
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		stop = true;
+	}
+	work_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
 	}
 }
@@ -20,11 +20,52 @@
  * These functions are grouped by 'tags', which allow some sequencing of calls.
  * (particularly, this is useful for loading large data blobs [e.g. Meshes] before looking up individual elements within them.)
  *
+ * Instead of a tag, a Load<> can list exactly which other Load<>s it needs with LoadAfter;
+ *  it then starts as soon as those are done, regardless of tags:
+ *
+ * Load< Mesh > main_mesh(LoadAfter{ meshes }, []() -> const Mesh * {
+ *     return &meshes->get("Main");
+ * });
+ *
+ * Loads that are just CPU work (reading files, decoding data) can pass 'LoadThreaded' to run on worker threads:
+ *
+ * Load< Level > level(LoadTagDefault, LoadThreaded, []() -> Level * {
+ *     return new Level(data_path("level.chunks"));
+ * }, [](Level *level) {
+ *     level->upload_to_gl(); //(optional) runs on the main thread once the load is done
+ * });
+ *
+ * Threaded loads run at the same time as any other load that is ready, so a threaded load
+ *  may only use values from Load<>s it comes after (by tag or by LoadAfter).
+ *
+ * call_load_functions() checks for dependency cycles before loading anything, and reports
+ *  where each Load<> in the cycle was declared.
+ *
+ * A LazyLoad< T > is not loaded by call_load_functions() at all, but the first time it is used
+ *  (so things a mode might never need don't delay the first frame). Threaded LazyLoad<>s can also
+ *  be prefetch()'d, which starts loading them on a background thread ahead of time:
+ *
+ * LazyLoad< Level > next_level(LoadThreaded, []() -> Level * {
+ *     return new Level(data_path("level2.chunks"));
+ * });
+ *
+ * //when level 1 starts:
+ * next_level.prefetch();
+ *
+ * //when level 2 starts (waits, if the prefetch hasn't finished yet):
+ * next_level->spawn_enemies();
+ *
  */
 
+#include <atomic>
+#include <condition_variable>
+#include <exception>
 #include <functional>
+#include <mutex>
+#include <source_location>
 #include <stdexcept>
 #include <cstdint>
+#include <vector>
 
 enum LoadTag : uint32_t {
 	LoadTagEarly,
@@ -33,15 +74,50 @@ enum LoadTag : uint32_t {
 	MaxLoadTag //<-- just used to track # of load tags
 };
 
+//A loading function plus everything call_load_functions() needs to schedule it:
+struct LoadFunction {
+	void const *key = nullptr; //identifies this load in other loads' 'depends' (Load<> uses its own address)
+	std::vector< void const * > depends; //keys of the loads this one comes after
+	bool after_tag = true; //if true, also comes after every load with an earlier tag (and no 'depends')
+	LoadTag tag = LoadTagDefault;
+	bool threaded = false; //run 'work' on a worker thread?
+	std::function< void() > work;
+	std::function< void() > finish; //(optional) called on the main thread after 'work', when 'threaded'
+	std::source_location location; //where the load was declared (for error messages)
+};
+
 //Add a function to an internal list of loading functions:
 // (only call *before* "call_load_functions()")
+void add_load_function(LoadFunction const &fn);
 void add_load_function(LoadTag tag, std::function< void() > const &fn);
 
+//Add a function to run on a worker thread, in parallel with the other loading functions in its tag:
+// (work_fn must not touch OpenGL; finish_fn, if not empty, is called on the main thread after work_fn returns)
+void add_threaded_load_function(LoadTag tag, std::function< void() > const &work_fn, std::function< void() > const &finish_fn);
+
 //Call all loading functions:
-// (loading functions may throw exceptions if they fail.)
+// (loading functions may throw exceptions if they fail -- including on worker threads, in which case the exception is rethrown here.)
+// (throws before calling anything if the loads' dependencies form a cycle)
 // (only call *once*)
 void call_load_functions();
 
+//Run a function on the background prefetch thread (functions run one at a time, in the order they were added):
+// (used by LazyLoad< T >::prefetch())
+void add_prefetch_function(std::function< void() > const &fn);
+
+//pass to Load< T >'s constructor to load on a worker thread:
+enum LoadThreadedTag { LoadThreaded };
+
+template< typename T >
+struct Load;
+
+//pass to Load< T >'s constructor (instead of a tag) to list the Load<>s it needs, e.g. 'LoadAfter{ meshes, textures }':
+struct LoadAfter {
+	template< typename... Ts >
+	LoadAfter(Load< Ts > const &... loads) : depends{ static_cast< void const * >(&loads)... } { }
+	std::vector< void const * > depends;
+};
+
 
 //work-around for MSVC not accepting this as a lambda:
 template< typename T >
@@ -50,13 +126,29 @@ T const *new_T() { return new T; }
 template< typename T >
 struct Load {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >) : value(nullptr) {
-		add_load_function(tag, [this,load_fn](){
-			this->value = load_fn();
-			if (!(this->value)) {
-				throw std::runtime_error("Loading failed.");
-			}
-		});
+	Load(LoadTag tag, const std::function< T const *() > &load_fn = new_T< T >, std::source_location location = std::source_location::current()) : value(nullptr) {
+		LoadFunction fn = main_load(load_fn, location);
+		fn.tag = tag;
+		add_load_function(fn);
+	}
+	Load(LoadAfter const &after, const std::function< T const *() > &load_fn, std::source_location location = std::source_location::current()) : value(nullptr) {
+		LoadFunction fn = main_load(load_fn, location);
+		fn.depends = after.depends;
+		fn.after_tag = false;
+		add_load_function(fn);
+	}
+
+	//Constructing a Load< T > with LoadThreaded runs load_fn on a worker thread, then finish_fn (if given) on the main thread:
+	Load(LoadTag tag, LoadThreadedTag, const std::function< T *() > &load_fn, const std::function< void(T *) > &finish_fn = nullptr, std::source_location location = std::source_location::current()) : value(nullptr) {
+		LoadFunction fn = threaded_load(load_fn, finish_fn, location);
+		fn.tag = tag;
+		add_load_function(fn);
+	}
+	Load(LoadAfter const &after, LoadThreadedTag, const std::function< T *() > &load_fn, const std::function< void(T *) > &finish_fn = nullptr, std::source_location location = std::source_location::current()) : value(nullptr) {
+		LoadFunction fn = threaded_load(load_fn, finish_fn, location);
+		fn.depends = after.depends;
+		fn.after_tag = false;
+		add_load_function(fn);
 	}
 
 	//Make a "Load< T >" behave like a "T const *":
@@ -66,6 +158,30 @@ struct Load {
 	T const *operator->() { return value; }
 
 	T const *value;
+
+	//(helpers for the constructors)
+	LoadFunction main_load(const std::function< T const *() > &load_fn, std::source_location const &location) {
+		LoadFunction fn;
+		fn.key = this;
+		fn.location = location;
+		fn.work = [this,load_fn](){
+			this->value = load_fn();
+			if (!(this->value)) {
+				throw std::runtime_error("Loading failed.");
+			}
+		};
+		return fn;
+	}
+	LoadFunction threaded_load(const std::function< T *() > &load_fn, const std::function< void(T *) > &finish_fn, std::source_location const &location) {
+		LoadFunction fn = main_load(load_fn, location);
+		fn.threaded = true;
+		if (finish_fn) {
+			fn.finish = [this,finish_fn](){
+				finish_fn(const_cast< T * >(this->value));
+			};
+		}
+		return fn;
+	}
 };
 
 
@@ -74,9 +190,118 @@ struct Load {
 template< >
 struct Load< void > {
 	//Constructing a Load< T > adds the passed function to the list of functions to call:
-	Load( LoadTag tag, const std::function< void() > &load_fn) {
-		add_load_function(tag, load_fn);
+	Load( LoadTag tag, const std::function< void() > &load_fn, std::source_location location = std::source_location::current()) {
+		LoadFunction fn;
+		fn.key = this;
+		fn.tag = tag;
+		fn.work = load_fn;
+		fn.location = location;
+		add_load_function(fn);
+	}
+	Load( LoadAfter const &after, const std::function< void() > &load_fn, std::source_location location = std::source_location::current()) {
+		LoadFunction fn;
+		fn.key = this;
+		fn.depends = after.depends;
+		fn.after_tag = false;
+		fn.work = load_fn;
+		fn.location = location;
+		add_load_function(fn);
 	}
 };
 
 
+//LazyLoad< T > is loaded the first time it is used, instead of by call_load_functions():
+template< typename T >
+struct LazyLoad {
+	//load_fn is called on the first use (on that thread -- so uses on the main thread may touch OpenGL):
+	LazyLoad(const std::function< T const *() > &load_fn_ = new_T< T >)
+		: load_fn([load_fn_](){ return const_cast< T * >(load_fn_()); }) {
+	}
+
+	//with LoadThreaded, load_fn may instead run on the background prefetch thread (if prefetch() is called);
+	// finish_fn (if given) is called on the thread that first uses the value (e.g., to upload to OpenGL):
+	LazyLoad(LoadThreadedTag, const std::function< T *() > &load_fn_, const std::function< void(T *) > &finish_fn_ = nullptr)
+		: load_fn(load_fn_), finish_fn(finish_fn_), threaded(true) {
+	}
+
+	LazyLoad(LazyLoad const &) = delete;
+	LazyLoad &operator=(LazyLoad const &) = delete;
+
+	//start loading on the background prefetch thread (does nothing unless LoadThreaded, or if loading has already started):
+	void prefetch() {
+		if (!threaded) return;
+		{
+			std::unique_lock< std::mutex > lock(mutex);
+			if (state != Unloaded) return;
+			state = Loading;
+		}
+		add_prefetch_function([this](){ run_load_fn(); });
+	}
+
+	//load (or wait for a prefetch to finish), if that hasn't happened yet; throws if loading failed:
+	T const *get() {
+		if (T const *ret = value.load(std::memory_order_acquire)) return ret;
+
+		std::unique_lock< std::mutex > lock(mutex);
+		if (state == Unloaded) {
+			state = Loading;
+			lock.unlock();
+			run_load_fn();
+			lock.lock();
+		}
+		loaded_cv.wait(lock, [this](){ return state != Loading; });
+		if (error) std::rethrow_exception(error);
+		if (state == Loaded) {
+			if (finish_fn) finish_fn(loaded);
+			state = Ready;
+			value.store(loaded, std::memory_order_release);
+		}
+		return loaded;
+	}
+
+	//true once get() has returned a value:
+	bool is_loaded() const { return value.load(std::memory_order_acquire) != nullptr; }
+
+	//Make a "LazyLoad< T >" behave like a "T const *" (loading on first use):
+	operator T const *() { return get(); }
+	T const &operator*() { return *get(); }
+	T const *operator->() { return get(); }
+
+	//--------------------------------------------------------------
+	//internals:
+
+	std::function< T *() > load_fn;
+	std::function< void(T *) > finish_fn;
+	bool threaded = false;
+
+	std::mutex mutex; //protects everything below but 'value'
+	std::condition_variable loaded_cv;
+	enum State {
+		Unloaded, //load_fn hasn't been called
+		Loading, //load_fn is running (on some thread)
+		Loaded, //load_fn is done (or failed, if 'error'), but finish_fn hasn't been called
+		Ready, //everything is done
+	} state = Unloaded;
+	T *loaded = nullptr;
+	std::exception_ptr error;
+
+	std::atomic< T const * > value{nullptr}; //set once Ready (so get() can skip the lock)
+
+	void run_load_fn() {
+		T *ret = nullptr;
+		std::exception_ptr ret_error;
+		try {
+			ret = load_fn();
+			if (!ret) {
+				throw std::runtime_error("Loading failed.");
+			}
+		} catch (...) {
+			ret_error = std::current_exception();
+		}
+		std::unique_lock< std::mutex > lock(mutex);
+		loaded = ret;
+		error = ret_error;
+		state = Loaded;
+		loaded_cv.notify_all();
+	}
+};
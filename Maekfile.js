@@ -31,6 +31,7 @@ if (maek.OS === "windows") {
 		`/I${NEST_LIBS}/SDL3/include`,
 		`/I${NEST_LIBS}/glm/include`,
 		`/I${NEST_LIBS}/libpng/include`,
+		`/I${NEST_LIBS}/zlib/include`,
 		//#disable a few warnings:
 		`/wd4146`, //-1U is still unsigned
 		`/wd4297`, //unforunately SDLmain is nothrow
@@ -50,7 +51,8 @@ if (maek.OS === "windows") {
 		//include paths for nest libraries:
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
-		`-I${NEST_LIBS}/libpng/include`
+		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`
 	);
 	maek.options.LINKLibs.push(
 		//linker flags for nest libraries:
@@ -64,7 +66,8 @@ if (maek.OS === "windows") {
 		//include paths for nest libraries:
 		`-I${NEST_LIBS}/SDL3/include`, `-D_THREAD_SAFE`,
 		`-I${NEST_LIBS}/glm/include`,
-		`-I${NEST_LIBS}/libpng/include`
+		`-I${NEST_LIBS}/libpng/include`,
+		`-I${NEST_LIBS}/zlib/include`
 	);
 	maek.options.LINKLibs.push(
 		//linker flags for nest libraries:
@@ -111,26 +114,73 @@ if (maek.OS === 'windows') {
 // cppFile: name of c++ file to compile
 // objFileBase (optional): base name object file to produce (if not supplied, set to options.objDir + '/' + cppFile without the extension)
 //returns objFile: objFileBase + a platform-dependant suffix ('.o' or '.obj')
+const decode_tile_obj = maek.CPP('decode_tile.cpp');
+const load_save_png_obj = maek.CPP('load_save_png.cpp');
+
 const game_objs = [
 	maek.CPP('PlayMode.cpp'),
 	maek.CPP('PPU466.cpp'),
-	maek.CPP('main.cpp'),
-	maek.CPP('load_save_png.cpp'),
+	maek.CPP('PPU466_software.cpp'),
+	maek.CPP('PPUStats.cpp'),
+	maek.CPP('FixedTimestep.cpp'),
+	maek.CPP('SimulationThread.cpp'),
+	maek.CPP('FrameProfiler.cpp'),
+	maek.CPP('FrameProfilerOverlay.cpp'),
+	maek.CPP('InputLog.cpp'),
+	maek.CPP('MappedFile.cpp'),
+	maek.CPP('AssetPack.cpp'),
+	maek.CPP('ChunkStream.cpp'),
+	maek.CPP('PPURenderPool.cpp'),
+	maek.CPP('SpriteMultiplexer.cpp'),
+	load_save_png_obj,
 	maek.CPP('Load.cpp'),
 	maek.CPP('data_path.cpp'),
 	maek.CPP('Mode.cpp'),
 	maek.CPP('gl_compile_program.cpp'),
-	maek.CPP('GL.cpp')
+	maek.CPP('GL.cpp'),
+	decode_tile_obj
 ];
 
 //the '[exeFile =] LINK(objFiles, exeFileBase, [, options])' links an array of objects into an executable:
 // objFiles: array of objects to link
 // exeFileBase: name of executable file to produce
 //returns exeFile: exeFileBase + a platform-dependant suffix (e.g., '.exe' on windows)
-const game_exe = maek.LINK(game_objs, 'dist/game');
 
-//set the default target to the game (and copy the readme files):
-maek.TARGETS = [game_exe, ...copies];
+//the '[outFile =] RUN(command, inputFiles, outFile)' runs a command (e.g., a tool built with LINK) to make a file:
+// command: array of command and arguments; command[0] is built first if it is a target
+// inputFiles: files the command reads (the command is re-run when they change)
+// outFile: file the command writes
+//returns outFile
+
+//tile + palette compiler -- turns the spritesheet and palette pngs into PPU466 data at build time:
+const compile_tiles_exe = maek.LINK([maek.CPP('compile-tiles.cpp'), load_save_png_obj], 'dist/compile-tiles');
+const spritesheet_tiles = maek.RUN(
+	[compile_tiles_exe, 'assets/spritesheet.png', 'assets/palettes.png', 'dist/spritesheet.tiles'],
+	['assets/spritesheet.png', 'assets/palettes.png'],
+	'dist/spritesheet.tiles'
+);
+
+//asset packer -- bundles the game's data into the single file it loads at startup:
+const pack_assets_exe = maek.LINK([maek.CPP('pack-assets.cpp')], 'dist/pack-assets');
+const assets_pack = maek.RUN(
+	[pack_assets_exe, 'dist/assets.pack', `spritesheet.tiles=${spritesheet_tiles}`],
+	[spritesheet_tiles],
+	'dist/assets.pack'
+);
+
+const game_exe = maek.LINK([maek.CPP('main.cpp'), ...game_objs], 'dist/game');
+
+//headless benchmark of PlayMode + PPU466 (run 'dist/bench' and compare numbers before/after a change):
+const bench_exe = maek.LINK([maek.CPP('bench.cpp'), ...game_objs], 'dist/bench');
+
+//micro-benchmark for the tile decoders (not built by default; build with 'node Maekfile.js dist/decode-tile-bench'):
+const decode_tile_bench_exe = maek.LINK([maek.CPP('decode-tile-bench.cpp'), decode_tile_obj], 'dist/decode-tile-bench');
+
+//checks for the software PPU466 renderer and SpriteMultiplexer (not built by default; build and run with 'node Maekfile.js dist/ppu-test && dist/ppu-test'):
+const ppu_test_exe = maek.LINK([maek.CPP('ppu-test.cpp'), ...game_objs], 'dist/ppu-test');
+
+//set the default targets to the game and benchmark, plus the data they load (and copy the readme files):
+maek.TARGETS = [game_exe, bench_exe, assets_pack, ...copies];
 
 //======================================================================
 //Now, onward to the code that makes all this work:
@@ -389,6 +439,33 @@ function init_maek() {
 		return exeFile;
 	};
 
+	//maek.RUN runs a command that makes a file:
+	// command is an array (command[0] may be an executable made by another task)
+	// inputFiles are the files the command reads; outFile is the file it writes
+	maek.RUN = (command, inputFiles, outFile) => {
+		const task = async () => {
+			await fsPromises.mkdir(path.dirname(outFile), { recursive: true });
+			await run(command, `${task.label}: run`,
+				async () => {
+					return {
+						read:[...inputFiles],
+						written:[outFile]
+					};
+				}
+			);
+		};
+
+		task.depends = [command[0], ...inputFiles];
+		task.label = `RUN ${outFile}`;
+
+		if (outFile in maek.tasks) {
+			throw new Error(`Task ${task.label} purports to create ${outFile}, but ${maek.tasks[outFile].label} already creates that file.`);
+		}
+		maek.tasks[outFile] = task;
+
+		return outFile;
+	};
+
 
 	//says something went wrong in building -- should fail loudly:
 	class BuildError extends Error {
@@ -577,6 +654,16 @@ function init_maek() {
 	// (used by run to figure out what to hash)
 	async function findExe(command) {
 		const osPath = require('path');
+		//commands with a directory in them (e.g., 'dist/compile-tiles') are relative to this file:
+		if (command[0].includes('/')) {
+			const exe = osPath.resolve(command[0]);
+			try {
+				await fsPromises.access(exe, fs.constants.X_OK);
+				return exe;
+			} catch (e) {
+				throw new BuildError(`Couldn't run '${command[0]}': ${e.message}`);
+			}
+		}
 		let PATH;
 		if (maek.OS === 'windows') {
 			PATH = process.env.PATH.split(';');
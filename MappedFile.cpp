@@ -0,0 +1,94 @@
+#include "MappedFile.hpp"
+
+#include <stdexcept>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#if defined(_WIN32)
+
+MappedFile::MappedFile(std::string const &filename_) : filename(filename_) {
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Failed to open '" + filename + "' (error " + std::to_string(GetLastError()) + ").");
+	}
+	file_handle = file;
+
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size)) {
+		DWORD error = GetLastError();
+		CloseHandle(file);
+		throw std::runtime_error("Failed to get the size of '" + filename + "' (error " + std::to_string(error) + ").");
+	}
+	size = size_t(file_size.QuadPart);
+
+	//(empty files can't be mapped, but there's nothing to map anyway)
+	if (size == 0) return;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		DWORD error = GetLastError();
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map '" + filename + "' (error " + std::to_string(error) + ").");
+	}
+	mapping_handle = mapping;
+
+	data = reinterpret_cast< char const * >(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (data == nullptr) {
+		DWORD error = GetLastError();
+		CloseHandle(mapping);
+		CloseHandle(file);
+		throw std::runtime_error("Failed to map a view of '" + filename + "' (error " + std::to_string(error) + ").");
+	}
+}
+
+MappedFile::~MappedFile() {
+	if (data) UnmapViewOfFile(data);
+	if (mapping_handle) CloseHandle(mapping_handle);
+	if (file_handle) CloseHandle(file_handle);
+}
+
+#else //POSIX
+
+MappedFile::MappedFile(std::string const &filename_) : filename(filename_) {
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Failed to open '" + filename + "': " + std::strerror(errno));
+	}
+
+	struct stat info;
+	if (fstat(fd, &info) != 0) {
+		int error = errno;
+		close(fd);
+		throw std::runtime_error("Failed to get the size of '" + filename + "': " + std::strerror(error));
+	}
+	size = size_t(info.st_size);
+
+	//(empty files can't be mapped, but there's nothing to map anyway)
+	if (size == 0) {
+		close(fd);
+		return;
+	}
+
+	void *mapped = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+	int error = errno;
+	close(fd); //(the mapping keeps the file open)
+	if (mapped == MAP_FAILED) {
+		throw std::runtime_error("Failed to map '" + filename + "': " + std::strerror(error));
+	}
+	data = reinterpret_cast< char const * >(mapped);
+}
+
+MappedFile::~MappedFile() {
+	if (data) munmap(const_cast< char * >(data), size);
+}
+
+#endif
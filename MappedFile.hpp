@@ -0,0 +1,38 @@
+#pragma once
+
+/*
+ * MappedFile -- a read-only memory mapping of a whole file.
+ *
+ * Nothing is read up front: pages are faulted in by the OS as bytes() is touched,
+ *  and pages of a file that is already in the OS's cache are shared rather than copied.
+ * Combine with map_chunk() (in read_write_chunk.hpp) to read chunk files without copying them.
+ *
+ */
+
+#include <cstddef>
+#include <span>
+#include <string>
+
+struct MappedFile {
+	//map 'filename' (throws on failure):
+	explicit MappedFile(std::string const &filename);
+	~MappedFile();
+
+	MappedFile(MappedFile const &) = delete;
+	MappedFile &operator=(MappedFile const &) = delete;
+
+	//the file's contents (valid for as long as the MappedFile exists):
+	std::span< char const > bytes() const { return std::span< char const >(data, size); }
+
+	std::string filename;
+
+	//--------------------------------------------------------------
+	//internals:
+
+	char const *data = nullptr;
+	size_t size = 0;
+#if defined(_WIN32)
+	void *file_handle = nullptr;
+	void *mapping_handle = nullptr;
+#endif
+};
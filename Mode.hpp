@@ -5,6 +5,8 @@
 
 #include <memory>
 
+struct PPU466;
+
 struct Mode : std::enable_shared_from_this< Mode > {
 	virtual ~Mode() { }
 
@@ -13,13 +15,25 @@ struct Mode : std::enable_shared_from_this< Mode > {
 	//The function should return 'true' if it handled the event.
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) { return false; }
 
-	//update is called at the start of a new frame, after events are handled:
-	// 'elapsed' is time in seconds since the last call to 'update'
+	//update is called zero or more times per frame, after events are handled:
+	// 'elapsed' is the length of one fixed simulation step, in seconds
+	// (main.cpp runs as many steps as needed to keep up with real time -- see FixedTimestep.hpp)
 	virtual void update(float elapsed) { }
 
 	//draw is called after update:
 	virtual void draw(glm::uvec2 const &drawable_size) = 0;
 
+	//(main.cpp actually calls this version, which also passes 'alpha':
+	// how far -- in [0,1) -- real time has gotten into the next update step, so modes can draw
+	// smoothly by interpolating between their last two updated states. By default, alpha is ignored.)
+	virtual void draw(glm::uvec2 const &drawable_size, float alpha) { draw(drawable_size); }
+
+	//snapshot is called instead of draw when the simulation runs on its own thread (see SimulationThread.hpp):
+	// it is called on the simulation thread after update, and should copy everything draw would show into 'ppu'
+	// as of the latest step (the render thread moves sprites between consecutive snapshots itself).
+	// Return false (the default) if this mode can't be drawn from a snapshot.
+	virtual bool snapshot(PPU466 *ppu) { return false; }
+
 	//Mode::current is the Mode to which events are dispatched.
 	// use 'set_current' to change the current Mode (e.g., to switch to a menu)
 	static std::shared_ptr< Mode > current;
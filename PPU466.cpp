@@ -4,10 +4,15 @@
 #include "GL.hpp"
 #include "gl_compile_program.hpp"
 #include "gl_errors.hpp"
+#include "decode_tile.hpp"
+#include "PPUStats.hpp"
 
 #include <glm/gtc/type_ptr.hpp>
 
 #include <vector>
+#include <algorithm>
+#include <mutex>
+#include <stdexcept>
 
 //In order to implement the PPU466 on modern graphics hardware, a fancy, special purpose tile-drawing shader is used:
 struct PPUTileProgram {
@@ -32,40 +37,567 @@ struct PPUTileProgram {
 //Initialize tile program and associated buffers:
 Load< PPUTileProgram > tile_program(LoadTagEarly); //will 'new PPUTileProgram()' by default
 
+//The instanced variant of the tile program expands one small per-instance record into a quad in the vertex shader:
+struct PPUInstancedTileProgram {
+	PPUInstancedTileProgram();
+	~PPUInstancedTileProgram();
+
+	GLuint program = 0;
+
+	//Attribute (per-instance variable) locations:
+	GLuint Instance_uvec4 = -1U;
+	GLuint RowMask_uint = -1U; //sprites only: which rows of the sprite to draw (see PPU466::SpriteEvaluation)
+
+	//Uniform (per-invocation variable) locations:
+	GLuint OBJECT_TO_CLIP_mat4 = -1U;
+	GLuint GRID_WIDTH_int = -1U; //> 0: instances are background entries laid out in rows this wide; 0: instances are sprites
+	GLuint PRIORITY_uint = -1U; //sprites whose priority bit (0x80 or 0x00) doesn't match this are skipped
+
+	//Textures bindings: (same as PPUTileProgram)
+	//TEXTURE0 - the tile table (as a 128x128 R8UI texture)
+	//TEXTURE1 - the palette table (as a 4x8 RGBA8 texture)
+};
+
+Load< PPUInstancedTileProgram > instanced_tile_program(LoadTagEarly);
+
+//The background program draws the whole background with one screen-covering triangle, looking up tiles per-pixel:
+struct PPUBackgroundProgram {
+	PPUBackgroundProgram();
+	~PPUBackgroundProgram();
+
+	GLuint program = 0;
+
+	//(no attributes -- the triangle's corners are computed from gl_VertexID)
+
+	//Uniform (per-invocation variable) locations:
+	GLuint BACKGROUND_POSITION_ivec2 = -1U; //in [0,512)x[0,480)
+
+	//Textures bindings:
+	//TEXTURE0 - the tile table (as a 128x128 R8UI texture)
+	//TEXTURE1 - the palette table (as a 4x8 RGBA8 texture)
+	//TEXTURE2 - the background (as a 64x60 R16UI texture)
+};
+
+//(only DrawMethod::FullscreenBackground uses it, so it is compiled on first use)
+LazyLoad< PPUBackgroundProgram > background_program;
+
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
+struct PPUCache;
+
 struct PPUDataStream {
 	PPUDataStream();
 	~PPUDataStream();
 
 	//vertex format for convenience:
+	// (packed into the smallest types that fit:
+	//   Position is within [0,512]x[0,480] for the background or [0,263]x[0,247] for sprites,
+	//   TileCoord is within [0,128]x[0,128],
+	//   Palette is a 3-bit palette index plus an 8-bit row mask)
 	struct Vertex {
 		Vertex(glm::ivec2 const &Position_, glm::ivec2 const &TileCoord_, int32_t const &Palette_)
-			: Position(Position_), TileCoord(TileCoord_), Palette(Palette_) { }
+			: Position(glm::i16vec2(Position_)), TileCoord(glm::u8vec2(TileCoord_)), Palette(uint16_t(Palette_)) { }
 		//I generally make class members lowercase, but I make an exception here because
 		// I use uppercase for vertex attributes in shader programs and want to match.
-		glm::ivec2 Position;
-		glm::ivec2 TileCoord;
-		int32_t Palette;
+		glm::i16vec2 Position;
+		glm::u8vec2 TileCoord;
+		uint16_t Palette;
+	};
+	static_assert(sizeof(Vertex) == 8, "Vertex is packed");
+
+	//--- used by DrawMethod::Vertices ---
+
+	//tiles are drawn as quads of four vertices each (in the order lower-left, upper-left, lower-right, upper-right),
+	// and this (static) index buffer turns every group of four vertices into two triangles:
+	GLuint quad_index_buffer = 0;
+	enum : uint32_t {
+		QuadIndices = 6, //indices per quad
+		QuadVertices = 4, //vertices per quad
+		MaxQuads = PPU466::BackgroundWidth * PPU466::BackgroundHeight, //enough for the whole background
+	};
+	static_assert(QuadVertices * MaxQuads <= 0x10000, "quad indices fit in 16 bits");
+
+	//sprite vertices are streamed through a ring of segments (see PPUCache::vertex_buffer):
+	enum : uint32_t {
+		VertexSegments = 3,
+		VertexSegmentSize = QuadVertices * std::tuple_size< decltype(PPU466::sprites) >::value, //in vertices
+	};
+
+	//--- used by DrawMethod::Instanced ---
+
+	//buffer that stores the sprite list (as-is; each PPU466::Sprite is one instance):
+	GLuint sprite_instance_buffer = 0;
+	//buffer that stores each sprite's row mask (one byte per instance):
+	GLuint sprite_row_mask_buffer = 0;
+	GLuint sprite_instance_buffer_for_instanced_tile_program = 0;
+
+	//--- used by DrawMethod::FullscreenBackground ---
+
+	//vertex array object with no attributes, for drawing the screen-covering triangle:
+	GLuint empty_vertex_array = 0;
+
+	//--- per-PPU state (see PPUCache, below) ---
+
+	//make vertex array objects that feed data in 'buffer' to the tile programs:
+	GLuint make_vertex_array_for_tile_program(GLuint buffer) const; //(Vertex-format data, drawn as quads using quad_index_buffer)
+	GLuint make_vertex_array_for_instanced_tile_program(GLuint buffer, GLint components) const; //('components' bytes per instance)
+
+	//PPUCaches that no PPU466 uses anymore, kept for reuse:
+	// (instead of deleted, since a PPU466 may well be destroyed after the OpenGL context is)
+	mutable std::mutex free_caches_mutex;
+	mutable std::vector< PPUCache * > free_caches;
+};
+
+Load< PPUDataStream > data_stream(LoadTagDefault);
+
+//The parts of a PPU466 that live on the GPU between draws (its tables, background, and sprite vertex ring), along with
+// copies of what was last uploaded so that draw() only uploads what changed.
+//Each PPU466 gets its own (see PPU466::gpu_cache), so different PPUs don't overwrite each other's uploads
+// (or cycle through each other's vertex segments):
+struct PPUCache {
+	PPUCache();
+	PPUCache(PPUCache const &) = delete;
+
+	//copy of the background as it was last uploaded to some buffer, used to re-upload only changed rows:
+	struct UploadedBackground {
+		std::array< uint16_t, PPU466::BackgroundWidth * PPU466::BackgroundHeight > background;
+		bool valid = false;
 	};
 
+	//--- used by DrawMethod::Vertices ---
+
 	//vertex buffer that will store data stream:
+	// it is a ring of segments, each big enough for one draw's sprites; successive draws write successive segments,
+	// so the CPU can fill one segment while the GPU may still be reading from the others.
+	// (each PPU466 has its own ring, so a segment is only reused after that PPU has drawn VertexSegments more times
+	//  -- usually that many frames -- no matter how many other PPUs are drawn in between)
 	GLuint vertex_buffer = 0;
+	uint32_t vertex_segment = 0; //segment to fill next
+	std::array< GLsync, PPUDataStream::VertexSegments > vertex_segment_fences{}; //signalled once the GPU is done reading each segment
 
 	//vertex array object that maps tile program attributes to vertex storage:
 	GLuint vertex_buffer_for_tile_program = 0;
 
+	//vertex buffer that persistently stores the background layer:
+	// (one quad per background tile, in background-relative pixel coordinates, rows stored in order)
+	GLuint background_buffer = 0;
+
+	//vertex array object that maps tile program attributes to background storage:
+	GLuint background_buffer_for_tile_program = 0;
+
+	UploadedBackground background_buffer_contents;
+
+	//--- used by DrawMethod::Instanced ---
+
+	//buffer that persistently stores the background (as-is; each 16-bit entry is one instance):
+	GLuint background_instance_buffer = 0;
+	GLuint background_instance_buffer_for_instanced_tile_program = 0;
+
+	UploadedBackground background_instance_buffer_contents;
+
+	//--- used by DrawMethod::FullscreenBackground ---
+
+	//texture object that persistently stores the background (as-is; one R16UI texel per entry):
+	GLuint background_tex = 0;
+
+	UploadedBackground background_tex_contents;
+
+	//--- used by all draw methods ---
+
 	//texture object that will store tile table:
 	GLuint tile_tex = 0;
 
 	//texture object that will store palette table:
 	GLuint palette_tex = 0;
+
+	//copies of the tile and palette tables as they were last uploaded, used to re-upload only changed tiles / palettes:
+	std::array< PPU466::Tile, 16 * 16 > uploaded_tile_table;
+	std::array< PPU466::Palette, 8 > uploaded_palette_table;
+	bool tables_uploaded = false;
+
+	//tile table as a 128 x 128 index image (as uploaded to tile_tex):
+	std::array< uint8_t, 128 * 128 > tile_tex_contents;
 };
 
-Load< PPUDataStream > data_stream(LoadTagDefault);
+//PPU466::gpu_cache holds a PPUCache, made on first draw; it goes back to data_stream for reuse once the last copy of the PPU466 is gone:
+struct PPU466::GPUCache {
+	GPUCache() = default;
+	GPUCache(GPUCache const &) = delete;
+	~GPUCache() {
+		if (!cache) return;
+		std::unique_lock< std::mutex > lock(data_stream->free_caches_mutex);
+		data_stream->free_caches.emplace_back(cache);
+	}
+	PPUCache *cache = nullptr;
+};
 
 //-------------------------------------------------------------------
 
-PPU466::PPU466() {
+namespace {
+	//matrix to transform [0,ScreenWidth]x[0,ScreenHeight] -> [-1,1]x[-1,1], after offsetting by 'offset' pixels:
+	glm::mat4 object_to_clip(glm::ivec2 const &offset) {
+		//NOTE: glm uses column-major matrices:
+		return glm::mat4(
+			glm::vec4(2.0f / float(PPU466::ScreenWidth), 0.0f, 0.0f, 0.0f),
+			glm::vec4(0.0f, 2.0f / float(PPU466::ScreenHeight), 0.0f, 0.0f),
+			glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
+			glm::vec4(2.0f * offset.x / float(PPU466::ScreenWidth) - 1.0f, 2.0f * offset.y / float(PPU466::ScreenHeight) - 1.0f, 0.0f, 1.0f)
+		);
+	}
+
+	//the PPUCache for 'ppu' (reusing a free one or making a new one, if this is its first draw):
+	PPUCache &get_cache(PPU466 const &ppu) {
+		assert(ppu.gpu_cache && "PPU466::gpu_cache is set by the constructor");
+		PPUCache *&cache = ppu.gpu_cache->cache;
+		if (!cache) {
+			std::unique_lock< std::mutex > lock(data_stream->free_caches_mutex);
+			if (!data_stream->free_caches.empty()) {
+				//(its 'uploaded' copies still match what is on the GPU, so it can be used as-is)
+				cache = data_stream->free_caches.back();
+				data_stream->free_caches.pop_back();
+			}
+		}
+		if (!cache) cache = new PPUCache;
+		return *cache;
+	}
+
+	//call 'upload(begin, end)' for every run of rows [begin,end) of 'background' that differ from 'uploaded', and update 'uploaded' to match:
+	template< typename F >
+	void upload_changed_rows(decltype(PPU466::background) const &background, PPUCache::UploadedBackground *uploaded_, F const &upload) {
+		assert(uploaded_);
+		auto &uploaded = *uploaded_;
+
+		constexpr uint32_t Width = PPU466::BackgroundWidth;
+		auto row_changed = [&](uint32_t y) {
+			return !uploaded.valid
+			    || !std::equal(
+			           background.begin() + Width * y,
+			           background.begin() + Width * (y + 1),
+			           uploaded.background.begin() + Width * y);
+		};
+
+		for (uint32_t y = 0; y < PPU466::BackgroundHeight; ) {
+			if (!row_changed(y)) {
+				++y;
+				continue;
+			}
+			uint32_t begin = y;
+			while (y < PPU466::BackgroundHeight && row_changed(y)) ++y;
+
+			upload(begin, y);
+
+			std::copy(background.begin() + Width * begin, background.begin() + Width * y, uploaded.background.begin() + Width * begin);
+		}
+		uploaded.valid = true;
+	}
+
+	//To simulate the 'infinite tiling' behavior, the background is drawn up to four times,
+	// each at an offset that causes it to overlap the screen.
+	//This helper calls 'draw(offset, row_begin, row_end)' for each such copy, along with the range of rows that overlap the screen:
+	template< typename F >
+	void for_each_background_copy(glm::ivec2 const &background_position, F const &draw) {
+		static_assert(PPU466::BackgroundWidth * 8 == PPU466::ScreenWidth * 2, "Background should be exactly twice the screen width.");
+		static_assert(PPU466::BackgroundHeight * 8 == PPU466::ScreenHeight * 2, "Background should be exactly twice the screen height.");
+
+		constexpr int32_t BackgroundWidthPixels = int32_t(PPU466::BackgroundWidth) * 8;
+		constexpr int32_t BackgroundHeightPixels = int32_t(PPU466::BackgroundHeight) * 8;
+
+		//position of the lower-left corner of the first copy, reduced to (-BackgroundWidthPixels,0] x (-BackgroundHeightPixels,0]:
+		glm::ivec2 base = glm::ivec2(
+			((background_position.x % BackgroundWidthPixels) - BackgroundWidthPixels) % BackgroundWidthPixels,
+			((background_position.y % BackgroundHeightPixels) - BackgroundHeightPixels) % BackgroundHeightPixels
+		);
+
+		for (int32_t pos_y : {base.y, base.y + BackgroundHeightPixels}) {
+			//rows of this copy that overlap the screen:
+			int32_t row_begin = std::max(0, -pos_y / 8);
+			int32_t row_end = std::min(int32_t(PPU466::BackgroundHeight), (int32_t(PPU466::ScreenHeight) - pos_y + 7) / 8);
+			if (row_begin >= row_end) continue;
+
+			for (int32_t pos_x : {base.x, base.x + BackgroundWidthPixels}) {
+				//skip copy if it doesn't overlap the screen:
+				if (pos_x >= int32_t(PPU466::ScreenWidth)) continue;
+
+				draw(glm::ivec2(pos_x, pos_y), uint32_t(row_begin), uint32_t(row_end));
+			}
+		}
+	}
+
+	//helpers to record stats (if the PPU has somewhere to record them):
+	void mark(PPU466 const &ppu, PPUStats::Phase phase) {
+		if (ppu.stats) ppu.stats->mark(phase);
+	}
+	void count_upload(PPU466 const &ppu, size_t bytes) {
+		if (ppu.stats) ppu.stats->count_upload(bytes);
+	}
+	void count_vertices(PPU466 const &ppu, size_t vertices) {
+		if (ppu.stats) ppu.stats->count_vertices(vertices);
+	}
+
+	//helper to put a single tile somewhere:
+	// writes a quad (four vertices; see PPUDataStream::quad_index_buffer) starting at 'quads' and returns a pointer just past it
+	// (only the rows of the tile set in 'row_mask' are drawn)
+	PPUDataStream::Vertex *draw_tile(PPUDataStream::Vertex *quads, glm::ivec2 const &lower_left, uint8_t tile_index, uint8_t palette_index, uint8_t row_mask = 0xff) {
+		//convert tile index to lower-left pixel coordinate in tile image:
+		glm::ivec2 tile_coord = glm::ivec2((tile_index % 16)*8, (tile_index / 16)*8);
+
+		//the row mask rides along in the upper bits of the palette attribute:
+		int32_t palette = int32_t(palette_index) | (int32_t(row_mask) << 8);
+
+		//(NOTE: 'quads' may point into mapped buffer memory, so it is only ever written, never read)
+		*(quads++) = PPUDataStream::Vertex(glm::ivec2(lower_left.x+0, lower_left.y+0), glm::ivec2(tile_coord.x+0, tile_coord.y+0), palette);
+		*(quads++) = PPUDataStream::Vertex(glm::ivec2(lower_left.x+0, lower_left.y+8), glm::ivec2(tile_coord.x+0, tile_coord.y+8), palette);
+		*(quads++) = PPUDataStream::Vertex(glm::ivec2(lower_left.x+8, lower_left.y+0), glm::ivec2(tile_coord.x+8, tile_coord.y+0), palette);
+		*(quads++) = PPUDataStream::Vertex(glm::ivec2(lower_left.x+8, lower_left.y+8), glm::ivec2(tile_coord.x+8, tile_coord.y+8), palette);
+		return quads;
+	}
+
+	//DrawMethod::Vertices -- every sprite is expanded to a quad; the background is kept as quads on the GPU:
+	void draw_vertices(PPU466 const &ppu, PPU466::SpriteEvaluation const &evaluation, PPUCache &cache) {
+		//build quads representing sprites directly in the next segment of the vertex buffer:
+		// (the background is stored persistently on the GPU; see below)
+
+		constexpr uint32_t SegmentSize = PPUDataStream::VertexSegmentSize;
+		static_assert(SegmentSize == PPUDataStream::QuadVertices * decltype(ppu.sprites)().size(), "segment fits every sprite");
+
+		uint32_t segment = cache.vertex_segment;
+		cache.vertex_segment = (segment + 1) % PPUDataStream::VertexSegments;
+
+		//the GPU should have finished with this segment frames ago, but make sure before overwriting it:
+		GLsync &fence = cache.vertex_segment_fences[segment];
+		if (fence != 0) {
+			while (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000) == GL_TIMEOUT_EXPIRED) {
+				//keep waiting
+			}
+			glDeleteSync(fence);
+			fence = 0;
+		}
+
+		glBindBuffer(GL_ARRAY_BUFFER, cache.vertex_buffer);
+		//"unsynchronized" because the fence already guarantees the GPU isn't using this range:
+		PPUDataStream::Vertex *mapped = reinterpret_cast< PPUDataStream::Vertex * >(glMapBufferRange(GL_ARRAY_BUFFER,
+			sizeof(PPUDataStream::Vertex) * SegmentSize * segment,
+			sizeof(PPUDataStream::Vertex) * SegmentSize,
+			GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT
+		));
+		if (!mapped) {
+			throw std::runtime_error("Failed to map PPU vertex buffer.");
+		}
+		PPUDataStream::Vertex *quads = mapped;
+
+		//helper to draw the sprite list (used because we need to draw the 'behind' sprites, then the background, then the 'front' sprites:
+		auto draw_sprites = [&ppu,&evaluation,&quads](uint8_t priority) {
+			for (uint32_t i = 0; i < ppu.sprites.size(); ++i) {
+				auto const &sprite = ppu.sprites[i];
+				if ((sprite.attributes & 0x80) != priority) continue;
+				if (evaluation.row_masks[i] == 0) continue; //culled (off-screen or entirely hidden by the sprites-per-line limit)
+				quads = draw_tile(
+					quads,
+					glm::ivec2(sprite.x, sprite.y),
+					sprite.index,
+					sprite.attributes & 0x07, //just the palette index part
+					evaluation.row_masks[i]
+				);
+			}
+		};
+
+		draw_sprites(0x80); //draw sprites with priority == 1 ('behind' sprites)
+		GLsizei behind_quads = GLsizei(quads - mapped) / PPUDataStream::QuadVertices;
+
+		draw_sprites(0x00); //draw sprites with priority == 0 ('in front' sprites)
+		GLsizei total_quads = GLsizei(quads - mapped) / PPUDataStream::QuadVertices;
+
+		assert(uint32_t(quads - mapped) <= SegmentSize && "Segment size was estimated conservatively.");
+
+		if (glUnmapBuffer(GL_ARRAY_BUFFER) == GL_FALSE) {
+			//buffer contents were lost (this can happen, e.g., on a display mode change), so skip sprites this frame:
+			behind_quads = total_quads = 0;
+		}
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		count_upload(ppu, sizeof(PPUDataStream::Vertex) * PPUDataStream::QuadVertices * total_quads);
+		mark(ppu, PPUStats::Sprites);
+
+		{ //upload any background rows that changed since the last draw:
+			//(runs of consecutive changed rows are rebuilt and uploaded together)
+			constexpr uint32_t RowVertices = uint32_t(PPUDataStream::QuadVertices) * PPU466::BackgroundWidth;
+			std::vector< PPUDataStream::Vertex > rows;
+
+			glBindBuffer(GL_ARRAY_BUFFER, cache.background_buffer);
+			upload_changed_rows(ppu.background, &cache.background_buffer_contents, [&](uint32_t begin, uint32_t end) {
+				rows.resize(RowVertices * (end - begin), PPUDataStream::Vertex(glm::ivec2(0), glm::ivec2(0), 0));
+				PPUDataStream::Vertex *row = rows.data();
+				for (uint32_t y = begin; y < end; ++y) {
+					for (uint32_t x = 0; x < PPU466::BackgroundWidth; ++x) {
+						uint16_t info = ppu.background[x + PPU466::BackgroundWidth * y];
+						row = draw_tile(
+							row,
+							glm::ivec2(8 * x, 8 * y),
+							info & 0xff, //extract tile index bits
+							(info >> 8) & 0x07 //extract palette index bits
+						);
+					}
+				}
+				assert(row == rows.data() + rows.size());
+				glBufferSubData(GL_ARRAY_BUFFER, sizeof(PPUDataStream::Vertex) * RowVertices * begin, sizeof(PPUDataStream::Vertex) * rows.size(), rows.data());
+				count_upload(ppu, sizeof(PPUDataStream::Vertex) * rows.size());
+			});
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		mark(ppu, PPUStats::Background);
+
+		// set the shader programs:
+		glUseProgram(tile_program->program);
+
+		//now that the pipeline is configured, trigger drawing of quads:
+		// (the index buffer always starts at quad zero, so the 'base vertex' picks which quads get drawn)
+		constexpr GLint Q = PPUDataStream::QuadVertices;
+		constexpr GLsizei I = PPUDataStream::QuadIndices;
+
+		//'behind' sprites:
+		glBindVertexArray(cache.vertex_buffer_for_tile_program);
+		glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip(glm::ivec2(0))));
+		const GLint first = GLint(SegmentSize * segment);
+		glDrawElementsBaseVertex(GL_TRIANGLES, I * behind_quads, GL_UNSIGNED_SHORT, (GLvoid *)0, first);
+
+		//background (only rows that overlap the screen):
+		glBindVertexArray(cache.background_buffer_for_tile_program);
+		for_each_background_copy(ppu.background_position, [&ppu](glm::ivec2 const &offset, uint32_t row_begin, uint32_t row_end) {
+			glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip(offset)));
+			glDrawElementsBaseVertex(GL_TRIANGLES, I * GLsizei(PPU466::BackgroundWidth * (row_end - row_begin)), GL_UNSIGNED_SHORT, (GLvoid *)0, Q * GLint(PPU466::BackgroundWidth * row_begin));
+			count_vertices(ppu, Q * PPU466::BackgroundWidth * (row_end - row_begin));
+		});
+
+		//'in front' sprites:
+		glBindVertexArray(cache.vertex_buffer_for_tile_program);
+		glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip(glm::ivec2(0))));
+		glDrawElementsBaseVertex(GL_TRIANGLES, I * (total_quads - behind_quads), GL_UNSIGNED_SHORT, (GLvoid *)0, first + Q * behind_quads);
+
+		count_vertices(ppu, Q * total_quads);
+
+		//remember when the GPU is done with this segment:
+		fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+		mark(ppu, PPUStats::Draw);
+	}
+
+	//upload the sprite list as-is (256 bytes) along with each sprite's row mask (64 bytes), for use by draw_sprite_instances:
+	void upload_sprite_instances(PPU466 const &ppu, PPU466::SpriteEvaluation const &evaluation) {
+		static_assert(sizeof(ppu.sprites) == 4 * decltype(ppu.sprites)().size(), "sprite list is packed");
+		glBindBuffer(GL_ARRAY_BUFFER, data_stream->sprite_instance_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(ppu.sprites), ppu.sprites.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, data_stream->sprite_row_mask_buffer);
+		glBufferData(GL_ARRAY_BUFFER, sizeof(evaluation.row_masks), evaluation.row_masks.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+		count_upload(ppu, sizeof(ppu.sprites) + sizeof(evaluation.row_masks));
+		mark(ppu, PPUStats::Sprites);
+	}
+
+	//draw all sprites with a given priority (others are discarded in the vertex shader):
+	void draw_sprite_instances(PPU466 const &ppu, uint8_t priority) {
+		glUseProgram(instanced_tile_program->program);
+		glBindVertexArray(data_stream->sprite_instance_buffer_for_instanced_tile_program);
+		glUniformMatrix4fv(instanced_tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip(glm::ivec2(0))));
+		glUniform1i(instanced_tile_program->GRID_WIDTH_int, 0);
+		glUniform1ui(instanced_tile_program->PRIORITY_uint, priority);
+		glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(ppu.sprites.size()));
+		count_vertices(ppu, 4 * ppu.sprites.size());
+	}
+
+	//DrawMethod::Instanced -- sprites and background entries are uploaded as-is and expanded to quads in the vertex shader:
+	void draw_instanced(PPU466 const &ppu, PPU466::SpriteEvaluation const &evaluation, PPUCache &cache) {
+		upload_sprite_instances(ppu, evaluation);
+
+		{ //upload any background rows that changed since the last draw:
+			glBindBuffer(GL_ARRAY_BUFFER, cache.background_instance_buffer);
+			upload_changed_rows(ppu.background, &cache.background_instance_buffer_contents, [&](uint32_t begin, uint32_t end) {
+				glBufferSubData(GL_ARRAY_BUFFER, sizeof(uint16_t) * PPU466::BackgroundWidth * begin, sizeof(uint16_t) * PPU466::BackgroundWidth * (end - begin), ppu.background.data() + PPU466::BackgroundWidth * begin);
+				count_upload(ppu, sizeof(uint16_t) * PPU466::BackgroundWidth * (end - begin));
+			});
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+		}
+
+		mark(ppu, PPUStats::Background);
+
+		draw_sprite_instances(ppu, 0x80); //draw sprites with priority == 1 ('behind' sprites)
+
+		//background:
+		glBindVertexArray(cache.background_instance_buffer_for_instanced_tile_program);
+		glUniform1i(instanced_tile_program->GRID_WIDTH_int, PPU466::BackgroundWidth);
+		for_each_background_copy(ppu.background_position, [&ppu,&cache](glm::ivec2 const &offset, uint32_t row_begin, uint32_t row_end) {
+			//no base instance in GL 3.3, so start the instance attribute at row 'row_begin' instead
+			// (gl_InstanceID still counts from zero, so the copy is moved up by 'row_begin' rows to match):
+			glBindBuffer(GL_ARRAY_BUFFER, cache.background_instance_buffer);
+			glVertexAttribIPointer(
+				instanced_tile_program->Instance_uvec4, //attribute
+				sizeof(uint16_t), //size
+				GL_UNSIGNED_BYTE, //type
+				sizeof(uint16_t), //stride
+				(GLbyte *)0 + sizeof(uint16_t) * PPU466::BackgroundWidth * row_begin //offset
+			);
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
+			glUniformMatrix4fv(instanced_tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(object_to_clip(offset + glm::ivec2(0, 8 * int32_t(row_begin)))));
+			glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 4, GLsizei(PPU466::BackgroundWidth * (row_end - row_begin)));
+			count_vertices(ppu, 4 * PPU466::BackgroundWidth * (row_end - row_begin));
+		});
+
+		draw_sprite_instances(ppu, 0x00); //draw sprites with priority == 0 ('in front' sprites)
+
+		mark(ppu, PPUStats::Draw);
+	}
+
+	//DrawMethod::FullscreenBackground -- sprites are instanced; the background is a texture resolved per-pixel by one big triangle:
+	void draw_fullscreen_background(PPU466 const &ppu, PPU466::SpriteEvaluation const &evaluation, PPUCache &cache) {
+		upload_sprite_instances(ppu, evaluation);
+
+		//the background texture lives on texture unit 2 for the whole draw:
+		// (draw() has already bound the tile and palette tables to units 0 and 1, so those must not be disturbed)
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, cache.background_tex);
+
+		//upload any background rows that changed since the last draw:
+		upload_changed_rows(ppu.background, &cache.background_tex_contents, [&](uint32_t begin, uint32_t end) {
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(begin), PPU466::BackgroundWidth, GLsizei(end - begin), GL_RED_INTEGER, GL_UNSIGNED_SHORT, ppu.background.data() + PPU466::BackgroundWidth * begin);
+			count_upload(ppu, sizeof(uint16_t) * PPU466::BackgroundWidth * (end - begin));
+		});
+
+		glActiveTexture(GL_TEXTURE0);
+
+		mark(ppu, PPUStats::Background);
+
+		draw_sprite_instances(ppu, 0x80); //draw sprites with priority == 1 ('behind' sprites)
+
+		{ //background:
+			glUseProgram(background_program->program);
+			glBindVertexArray(data_stream->empty_vertex_array);
+
+			//scrolling is just a uniform; it is reduced to [0,BackgroundWidthPixels)x[0,BackgroundHeightPixels) here
+			// so that the shader only ever takes the modulus of non-negative values:
+			constexpr int32_t BackgroundWidthPixels = int32_t(PPU466::BackgroundWidth) * 8;
+			constexpr int32_t BackgroundHeightPixels = int32_t(PPU466::BackgroundHeight) * 8;
+			glUniform2i(background_program->BACKGROUND_POSITION_ivec2,
+				((ppu.background_position.x % BackgroundWidthPixels) + BackgroundWidthPixels) % BackgroundWidthPixels,
+				((ppu.background_position.y % BackgroundHeightPixels) + BackgroundHeightPixels) % BackgroundHeightPixels
+			);
+
+			glDrawArrays(GL_TRIANGLES, 0, 3);
+			count_vertices(ppu, 3);
+		}
+
+		draw_sprite_instances(ppu, 0x00); //draw sprites with priority == 0 ('in front' sprites)
+
+		glActiveTexture(GL_TEXTURE2);
+		glBindTexture(GL_TEXTURE_2D, 0);
+		glActiveTexture(GL_TEXTURE0);
+
+		mark(ppu, PPUStats::Draw);
+	}
+}
+
+//-------------------------------------------------------------------
+
+PPU466::PPU466() : gpu_cache(std::make_shared< GPUCache >()) {
 	for (auto &palette : palette_table) {
 		palette[0] = glm::u8vec4(0x00, 0x00, 0x00, 0x00);
 		palette[1] = glm::u8vec4(0x44, 0x44, 0x44, 0xff);
@@ -87,6 +619,11 @@ PPU466::PPU466() {
 }
 
 void PPU466::draw(glm::uvec2 const &drawable_size) const {
+	if (stats) {
+		stats->begin_frame();
+		stats->begin_gpu_timer();
+	}
+
 	//this code does screen scaling by manipulating the viewport, so save old values:
 	GLint old_viewport[4];
 	glGetIntegerv(GL_VIEWPORT, old_viewport);
@@ -95,13 +632,15 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 	glViewport(0,0,drawable_size.x,drawable_size.y);
 
 	//background gets background color:
-	glClearColor(
-		background_color.r / 255.0f, 
-		background_color.g / 255.0f, 
-		background_color.b / 255.0f,
-		1.0f
-	);
-	glClear(GL_COLOR_BUFFER_BIT);
+	if (clear_screen) {
+		glClearColor(
+			background_color.r / 255.0f, 
+			background_color.g / 255.0f, 
+			background_color.b / 255.0f,
+			1.0f
+		);
+		glClear(GL_COLOR_BUFFER_BIT);
+	}
 
 	//set up screen scaling:
 	if (drawable_size.x < ScreenWidth || drawable_size.y < ScreenHeight) {
@@ -120,124 +659,74 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 		glViewport(lower_left.x, lower_left.y, scale * ScreenWidth, scale * ScreenHeight);
 	}
 
-	//build triangle strip representing background and sprites:
-
-	constexpr uint32_t TristripSize = uint32_t(6 * (BackgroundWidth * BackgroundHeight + decltype(sprites)().size()));
-	std::vector< PPUDataStream::Vertex > triangle_strip;
-	triangle_strip.reserve(TristripSize);
-
-	//helper to put a single tile somewhere on the screen:
-	auto draw_tile = [&triangle_strip](glm::ivec2 const &lower_left, uint8_t tile_index, uint8_t palette_index){
-		//convert tile index to lower-left pixel coordinate in tile image:
-		glm::ivec2 tile_coord = glm::ivec2((tile_index % 16)*8, (tile_index / 16)*8);
-
-		//build a quad as a (very short) triangle strip that starts and ends with degenerate triangles:
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+0, lower_left.y+0), glm::ivec2(tile_coord.x+0, tile_coord.y+0), palette_index);
-		triangle_strip.emplace_back(triangle_strip.back());
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+0, lower_left.y+8), glm::ivec2(tile_coord.x+0, tile_coord.y+8), palette_index);
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+8, lower_left.y+0), glm::ivec2(tile_coord.x+8, tile_coord.y+0), palette_index);
-		triangle_strip.emplace_back(glm::ivec2(lower_left.x+8, lower_left.y+8), glm::ivec2(tile_coord.x+8, tile_coord.y+8), palette_index);
-		triangle_strip.emplace_back(triangle_strip.back());
-	};
-
-	//helper to draw the sprite list (used because we need to draw the 'behind' sprites, then the background, then the 'front' sprites:
-	auto draw_sprites = [this,&draw_tile](uint8_t priority) {
-		for (auto const &sprite : sprites) {
-			if ((sprite.attributes & 0x80) != priority) continue;
-			draw_tile(
-				glm::ivec2(sprite.x, sprite.y),
-				sprite.index,
-				sprite.attributes & 0x07 //just the palette index part
-			);
-		}
-	};
-
-	draw_sprites(0x80); //draw sprites with priority == 1 ('behind' sprites)
-
-	{ //draw the background:
-		//To simulate the 'infinite tiling' behavior this code draws the background as four screen-sized chunks,
-		// each of which is drawn at an offset that causes it to overlap the screen.
-
-		static_assert(BackgroundWidth * 8 == ScreenWidth * 2, "Background should be exactly twice the screen width.");
-		static_assert(BackgroundHeight * 8 == ScreenHeight * 2, "Background should be exactly twice the screen height.");
-
-		for (int32_t chunk_y : {0, int32_t(ScreenHeight)}) {
-			for (int32_t chunk_x : {0, int32_t(ScreenWidth)}) {
-				//position of the lower-left corner of the chunk:
-				glm::ivec2 pos = glm::ivec2(chunk_x, chunk_y) + background_position;
-
-				constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
-				constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+	//work out which rows of which sprites get drawn:
+	SpriteEvaluation evaluation;
+	evaluate_sprites(&evaluation);
 
-				//reduce to (-BackgroundWidthPixels,0] x (-BackgroundHeightPixels,0]:
-				pos.x = ((pos.x % BackgroundWidthPixels) - BackgroundWidthPixels) % BackgroundWidthPixels;
-				pos.y = ((pos.y % BackgroundHeightPixels) - BackgroundHeightPixels) % BackgroundHeightPixels;
-
-				//move chunk if it doesn't overlap the screen:
-				if (pos.x + int32_t(ScreenWidth) <= 0) pos.x += BackgroundWidthPixels;
-				if (pos.y + int32_t(ScreenHeight) <= 0) pos.y += BackgroundHeightPixels;
-
-				int32_t ox = chunk_x / 8;
-				int32_t oy = chunk_y / 8;
-				for (int32_t y = 0; y < int32_t(BackgroundHeight)/2; ++y) {
-					for (int32_t x = 0; x < int32_t(BackgroundWidth)/2; ++x) {
-						uint16_t info = background[(x + ox) + BackgroundWidth * (y + oy)];
-						draw_tile(
-							glm::ivec2(pos.x + 8*x, pos.y + 8*y),
-							info & 0xff, //extract tile index bits
-							(info >> 8) & 0x07 //extract palette index bits
-						);
-					}
-				}
-
-			}
-		}
-	}
-
-	draw_sprites(0x00); //draw sprites with priority == 0 ('in front' sprites)
-
-	assert(triangle_strip.size() == TristripSize && "Triangle strip size was estimated exactly.");
+	mark(*this, PPUStats::Setup);
 
 	//-------------------------------------------------
-	//Upload at to GPU using PPUDataStream:
+	//Upload at to GPU using PPUDataStream (and this PPU's own PPUCache):
+
+	PPUCache &cache = get_cache(*this);
 
-	{ //upload palette texture:
+	{ //upload any palettes that changed since the last draw:
 		static_assert(sizeof(palette_table) == 4 * 4 * decltype(palette_table)().size(), "palette table is packed");
-		glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 4, GLsizei(palette_table.size()), 0, GL_RGBA, GL_UNSIGNED_BYTE, palette_table.data());
+		auto &uploaded = cache.uploaded_palette_table;
+		glBindTexture(GL_TEXTURE_2D, cache.palette_tex);
+		for (uint32_t i = 0; i < palette_table.size(); ++i) {
+			if (cache.tables_uploaded && palette_table[i] == uploaded[i]) continue;
+			glTexSubImage2D(GL_TEXTURE_2D, 0, 0, GLint(i), 4, 1, GL_RGBA, GL_UNSIGNED_BYTE, palette_table[i].data());
+			count_upload(*this, sizeof(palette_table[i]));
+			uploaded[i] = palette_table[i];
+		}
 		glBindTexture(GL_TEXTURE_2D, 0);
 	}
 
-	{ //build + upload tile table texture:
-		//interpret tiles and build a 128 x 128 index texture:
-		static std::array< uint8_t, 128 * 128 > data;
+	{ //decode + upload any tiles that changed since the last draw:
+		auto &uploaded = cache.uploaded_tile_table;
+		auto &data = cache.tile_tex_contents;
+
+		//find changed tiles and decode them into the 128 x 128 index image:
+		std::array< uint8_t, 16 * 16 > changed; //list of changed tile indices
+		uint32_t changed_count = 0;
 		for (uint32_t i = 0; i < tile_table.size(); ++i) {
 			Tile const &tile = tile_table[i];
+			if (cache.tables_uploaded && tile.bit0 == uploaded[i].bit0 && tile.bit1 == uploaded[i].bit1) continue;
 
 			//location of tile in the texture:
 			uint32_t ox = (i % 16) * 8;
 			uint32_t oy = (i / 16) * 8;
+			decode_tile(tile, &data[ox + 128 * oy], 128);
 
-			//copy tile indices into texture:
-			for (uint32_t y = 0; y < 8; ++y) {
-				for (uint32_t x = 0; x < 8; ++x) {
-					data[ox+x + 128 * (oy+y)] =
-						  ((tile.bit0[y] >> x) & 1)
-						| ((tile.bit1[y] >> x) & 1) << 1;
+			uploaded[i] = tile;
+			changed[changed_count++] = uint8_t(i);
+		}
+
+		if (changed_count > 0) {
+			glBindTexture(GL_TEXTURE_2D, cache.tile_tex);
+			if (changed_count == tile_table.size()) {
+				//everything changed (e.g., first draw), so just upload the whole image:
+				glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 128, 128, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
+				count_upload(*this, data.size());
+			} else {
+				//upload just the 8x8 blocks that changed, reading them directly out of the full image:
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, 128);
+				for (uint32_t c = 0; c < changed_count; ++c) {
+					uint32_t ox = (changed[c] % 16) * 8;
+					uint32_t oy = (changed[c] / 16) * 8;
+					glTexSubImage2D(GL_TEXTURE_2D, 0, GLint(ox), GLint(oy), 8, 8, GL_RED_INTEGER, GL_UNSIGNED_BYTE, &data[ox + 128 * oy]);
+					count_upload(*this, 8 * 8);
 				}
+				glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
 			}
+			glBindTexture(GL_TEXTURE_2D, 0);
 		}
 
-		glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8UI, 128, 128, 0, GL_RED_INTEGER, GL_UNSIGNED_BYTE, data.data());
-		glBindTexture(GL_TEXTURE_2D, 0);
+		cache.tables_uploaded = true;
 	}
 
-	{ //upload vertex data:
-		glBindBuffer(GL_ARRAY_BUFFER, data_stream->vertex_buffer);
-		glBufferData(GL_ARRAY_BUFFER, sizeof(decltype(triangle_strip[0])) * triangle_strip.size(), triangle_strip.data(), GL_STREAM_DRAW);
-		glBindBuffer(GL_ARRAY_BUFFER, 0);
-	}
+	mark(*this, PPUStats::Tables);
 
 	//set up the pipeline:
 	// set blending function for output fragments:
@@ -245,32 +734,20 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 	glBlendEquation(GL_FUNC_ADD);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-	// set the shader programs:
-	glUseProgram(tile_program->program);
-
-	// configure attribute streams:
-	glBindVertexArray(data_stream->vertex_buffer_for_tile_program);
-
-	// set uniforms for shader programs:
-	{ //set matrix to transform [0,ScreenWidth]x[0,ScreenHeight] -> [-1,1]x[-1,1]:
-		//NOTE: glm uses column-major matrices:
-		glm::mat4 OBJECT_TO_CLIP = glm::mat4(
-			glm::vec4(2.0f / float(ScreenWidth), 0.0f, 0.0f, 0.0f),
-			glm::vec4(0.0f, 2.0f / float(ScreenHeight), 0.0f, 0.0f),
-			glm::vec4(0.0f, 0.0f, 1.0f, 0.0f),
-			glm::vec4(-1.0f,-1.0f, 0.0f, 1.0f)
-		);
-		glUniformMatrix4fv(tile_program->OBJECT_TO_CLIP_mat4, 1, GL_FALSE, glm::value_ptr(OBJECT_TO_CLIP));
-	}
-
 	// bind texture units to proper texture objects:
 	glActiveTexture(GL_TEXTURE1);
-	glBindTexture(GL_TEXTURE_2D, data_stream->palette_tex);
+	glBindTexture(GL_TEXTURE_2D, cache.palette_tex);
 	glActiveTexture(GL_TEXTURE0);
-	glBindTexture(GL_TEXTURE_2D, data_stream->tile_tex);
+	glBindTexture(GL_TEXTURE_2D, cache.tile_tex);
 
-	//now that the pipeline is configured, trigger drawing of triangle strip:
-	glDrawArrays(GL_TRIANGLE_STRIP, 0, GLsizei(triangle_strip.size()));
+	//upload sprites + background and draw them (in back-to-front order) using the selected method:
+	if (draw_method == DrawMethod::Instanced) {
+		draw_instanced(*this, evaluation, cache);
+	} else if (draw_method == DrawMethod::FullscreenBackground) {
+		draw_fullscreen_background(*this, evaluation, cache);
+	} else {
+		draw_vertices(*this, evaluation, cache);
+	}
 
 	//return state to default:
 	glActiveTexture(GL_TEXTURE1);
@@ -286,12 +763,38 @@ void PPU466::draw(glm::uvec2 const &drawable_size) const {
 	//also restore viewport, since earlier scaling code messed with it:
 	glViewport(old_viewport[0], old_viewport[1], old_viewport[2], old_viewport[3]);
 
+	if (stats) {
+		stats->end_gpu_timer();
+		stats->mark(PPUStats::Draw);
+		stats->end_frame();
+	}
+
 	GL_ERRORS();
 }
 
 
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
+//both tile programs share a fragment shader that looks up colors in the tile and palette tables:
+static char const *PPUTileFragmentShader =
+	"#version 330\n"
+	"uniform usampler2D TILE_TABLE;\n"
+	"uniform sampler2D PALETTE_TABLE;\n"
+	"in vec2 tileCoord;\n"
+	"flat in int palette;\n" //"flat" means "uses the value of the provoking [by default, last] vertex in the primitive"
+	"out vec4 fragColor;\n"
+	"void main() {\n"
+	//bits 0-2 of 'palette' are the palette index; bits 8-15 say which rows of the tile to draw:
+	"	ivec2 at = ivec2(tileCoord);\n"
+	"	if ((palette & (0x100 << (at.y & 7))) == 0) discard;\n"
+	"	uint index = texelFetch(TILE_TABLE, at, 0).r;\n"
+	"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette & 7), 0);\n"
+	//"	fragColor = vec4(float(index)/4.0,float(palette)/8,1,1);\n"
+	//"	fragColor = texelFetch(TILE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(TILE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(TILE_TABLE,0).y), 0);\n"
+	//"	fragColor = texelFetch(PALETTE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(PALETTE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(PALETTE_TABLE,0).y), 0);\n"
+	"}\n"
+;
+
 PPUTileProgram::PPUTileProgram() {
 	program = gl_compile_program(
 		//vertex shader:
@@ -309,19 +812,7 @@ PPUTileProgram::PPUTileProgram() {
 		"}\n"
 	,
 		//fragment shader:
-		"#version 330\n"
-		"uniform usampler2D TILE_TABLE;\n"
-		"uniform sampler2D PALETTE_TABLE;\n"
-		"in vec2 tileCoord;\n"
-		"flat in int palette;\n" //"flat" means "uses the value of the provoking [by default, last] vertex in the primitive"
-		"out vec4 fragColor;\n"
-		"void main() {\n"
-		"	uint index = texelFetch(TILE_TABLE, ivec2(tileCoord), 0).r;\n"
-		"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
-		//"	fragColor = vec4(float(index)/4.0,float(palette)/8,1,1);\n"
-		//"	fragColor = texelFetch(TILE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(TILE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(TILE_TABLE,0).y), 0);\n"
-		//"	fragColor = texelFetch(PALETTE_TABLE, ivec2(int(gl_FragCoord.x) % textureSize(PALETTE_TABLE,0).x, int(gl_FragCoord.y) % textureSize(PALETTE_TABLE,0).y), 0);\n"
-		"}\n"
+		PPUTileFragmentShader
 	);
 
 	//look up the locations of vertex attributes:
@@ -351,25 +842,221 @@ PPUTileProgram::~PPUTileProgram() {
 	}
 }
 
+PPUInstancedTileProgram::PPUInstancedTileProgram() {
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"uniform mat4 OBJECT_TO_CLIP;\n"
+		"uniform int GRID_WIDTH;\n"
+		"uniform uint PRIORITY;\n"
+		"in uvec4 Instance;\n" //a PPU466::Sprite, or (when GRID_WIDTH > 0) the two bytes of a background entry
+		"in uint RowMask;\n" //(sprites only) rows of the sprite to draw
+		"out vec2 tileCoord;\n"
+		"flat out int palette;\n"
+		"void main() {\n"
+		//the quad is drawn as a four-vertex triangle strip:
+		"	ivec2 corner = 8 * ivec2(gl_VertexID & 1, gl_VertexID >> 1);\n"
+		"	ivec2 at;\n"
+		"	uint index;\n"
+		"	uint attributes;\n"
+		"	uint rows = 0xffu;\n"
+		"	if (GRID_WIDTH > 0) {\n"
+		"		at = 8 * ivec2(gl_InstanceID % GRID_WIDTH, gl_InstanceID / GRID_WIDTH);\n"
+		"		index = Instance.x;\n"
+		"		attributes = Instance.y;\n"
+		"	} else {\n"
+		"		at = ivec2(Instance.xy);\n"
+		"		index = Instance.z;\n"
+		"		attributes = Instance.w;\n"
+		"		rows = RowMask;\n"
+		"		if ((attributes & 0x80u) != PRIORITY || rows == 0u) {\n"
+		//not drawn in this pass (or culled); collapse to a (clipped) point:
+		"			gl_Position = vec4(2.0, 2.0, 2.0, 1.0);\n"
+		"			tileCoord = vec2(0.0);\n"
+		"			palette = 0;\n"
+		"			return;\n"
+		"		}\n"
+		"	}\n"
+		"	gl_Position = OBJECT_TO_CLIP * vec4(at + corner, 0.0, 1.0);\n"
+		"	tileCoord = vec2(8 * ivec2(index % 16u, index / 16u) + corner);\n"
+		"	palette = int((attributes & 7u) | (rows << 8));\n"
+		"}\n"
+	,
+		//fragment shader:
+		PPUTileFragmentShader
+	);
+
+	//look up the locations of vertex attributes:
+	Instance_uvec4 = glGetAttribLocation(program, "Instance");
+	RowMask_uint = glGetAttribLocation(program, "RowMask");
+
+	//look up the locations of uniforms:
+	OBJECT_TO_CLIP_mat4 = glGetUniformLocation(program, "OBJECT_TO_CLIP");
+	GRID_WIDTH_int = glGetUniformLocation(program, "GRID_WIDTH");
+	PRIORITY_uint = glGetUniformLocation(program, "PRIORITY");
+
+	GLuint TILE_TABLE_usampler2D = glGetUniformLocation(program, "TILE_TABLE");
+	GLuint PALETTE_TABLE_sampler2D = glGetUniformLocation(program, "PALETTE_TABLE");
+
+	//bind texture units indices to samplers:
+	glUseProgram(program);
+	glUniform1i(TILE_TABLE_usampler2D, 0);
+	glUniform1i(PALETTE_TABLE_sampler2D, 1);
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
+
+PPUInstancedTileProgram::~PPUInstancedTileProgram() {
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+}
+
+PPUBackgroundProgram::PPUBackgroundProgram() {
+	program = gl_compile_program(
+		//vertex shader:
+		"#version 330\n"
+		"out vec2 screenCoord;\n"
+		"void main() {\n"
+		//one triangle with corners (-1,-1), (3,-1), (-1,3) covers all of clip space:
+		"	vec2 Position = vec2(4 * ivec2(gl_VertexID & 1, gl_VertexID >> 1) - 1);\n"
+		"	gl_Position = vec4(Position, 0.0, 1.0);\n"
+		//screen pixel coordinates ([0,256]x[0,240] over the visible part):
+		"	screenCoord = (0.5 * Position + 0.5) * vec2(256.0, 240.0);\n"
+		"}\n"
+	,
+		//fragment shader:
+		"#version 330\n"
+		"uniform usampler2D TILE_TABLE;\n"
+		"uniform sampler2D PALETTE_TABLE;\n"
+		"uniform usampler2D BACKGROUND;\n"
+		"uniform ivec2 BACKGROUND_POSITION;\n"
+		"in vec2 screenCoord;\n"
+		"out vec4 fragColor;\n"
+		"void main() {\n"
+		//background pixel under this screen pixel (wrapping around):
+		"	ivec2 size = 8 * textureSize(BACKGROUND, 0);\n"
+		"	ivec2 px = (ivec2(floor(screenCoord)) - BACKGROUND_POSITION + size) % size;\n"
+		"	uint info = texelFetch(BACKGROUND, px / 8, 0).r;\n"
+		"	int tile = int(info & 0xffu);\n" //tile index bits
+		"	int palette = int((info >> 8) & 7u);\n" //palette index bits
+		"	uint index = texelFetch(TILE_TABLE, 8 * ivec2(tile % 16, tile / 16) + px % 8, 0).r;\n"
+		"	fragColor = texelFetch(PALETTE_TABLE, ivec2(index, palette), 0);\n"
+		"}\n"
+	);
+
+	//look up the locations of uniforms:
+	BACKGROUND_POSITION_ivec2 = glGetUniformLocation(program, "BACKGROUND_POSITION");
+
+	GLuint TILE_TABLE_usampler2D = glGetUniformLocation(program, "TILE_TABLE");
+	GLuint PALETTE_TABLE_sampler2D = glGetUniformLocation(program, "PALETTE_TABLE");
+	GLuint BACKGROUND_usampler2D = glGetUniformLocation(program, "BACKGROUND");
+
+	//bind texture units indices to samplers:
+	glUseProgram(program);
+	glUniform1i(TILE_TABLE_usampler2D, 0);
+	glUniform1i(PALETTE_TABLE_sampler2D, 1);
+	glUniform1i(BACKGROUND_usampler2D, 2);
+	glUseProgram(0);
+
+	GL_ERRORS();
+}
+
+PPUBackgroundProgram::~PPUBackgroundProgram() {
+	if (program != 0) {
+		glDeleteProgram(program);
+		program = 0;
+	}
+}
+
 // - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - - -
 
 
 //PPU data is streamed to the GPU (read: uploaded 'just in time') using a few buffers:
 PPUDataStream::PPUDataStream() {
 
-	//vertex_buffer_for_tile_program is a vertex array object that tells the GPU the layout of data in vertex_buffer:
-	glGenVertexArrays(1, &vertex_buffer_for_tile_program);
-	glBindVertexArray(vertex_buffer_for_tile_program);
+	{ //quad_index_buffer holds indices for MaxQuads quads, and never changes:
+		std::vector< uint16_t > indices;
+		indices.reserve(QuadIndices * MaxQuads);
+		for (uint32_t q = 0; q < MaxQuads; ++q) {
+			uint16_t v = uint16_t(QuadVertices * q);
+			//two triangles: (lower-left, upper-left, lower-right) and (lower-right, upper-left, upper-right)
+			indices.insert(indices.end(), { uint16_t(v+0), uint16_t(v+1), uint16_t(v+2), uint16_t(v+2), uint16_t(v+1), uint16_t(v+3) });
+		}
+		glGenBuffers(1, &quad_index_buffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * indices.size(), indices.data(), GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
 
-	//vertex_buffer will (eventually) hold vertex data for drawing:
-	glGenBuffers(1, &vertex_buffer);
-	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	//sprite_instance_buffer holds the sprite list, copied as-is each frame:
+	glGenBuffers(1, &sprite_instance_buffer);
+	sprite_instance_buffer_for_instanced_tile_program = make_vertex_array_for_instanced_tile_program(sprite_instance_buffer, sizeof(PPU466::Sprite));
+
+	//sprite_row_mask_buffer holds the sprite row masks (also per-instance), copied each frame:
+	glGenBuffers(1, &sprite_row_mask_buffer);
+	glBindVertexArray(sprite_instance_buffer_for_instanced_tile_program);
+	glBindBuffer(GL_ARRAY_BUFFER, sprite_row_mask_buffer);
+	glVertexAttribIPointer(
+		instanced_tile_program->RowMask_uint, //attribute
+		1, //size
+		GL_UNSIGNED_BYTE, //type
+		1, //stride
+		(GLbyte *)0 //offset
+	);
+	glEnableVertexAttribArray(instanced_tile_program->RowMask_uint);
+	glVertexAttribDivisor(instanced_tile_program->RowMask_uint, 1);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glBindVertexArray(0);
+
+	//the screen-covering triangle has no attributes, but core profile still needs a vertex array object bound to draw:
+	glGenVertexArrays(1, &empty_vertex_array);
+
+	GL_ERRORS();
+}
+
+PPUDataStream::~PPUDataStream() {
+	//helpers to delete (and clear) object names:
+	auto delete_vertex_array = [](GLuint *vao) {
+		if (*vao != 0) {
+			glDeleteVertexArrays(1, vao);
+			*vao = 0;
+		}
+	};
+	auto delete_buffer = [](GLuint *buffer) {
+		if (*buffer != 0) {
+			glDeleteBuffers(1, buffer);
+			*buffer = 0;
+		}
+	};
+
+	delete_buffer(&quad_index_buffer);
+
+	delete_vertex_array(&sprite_instance_buffer_for_instanced_tile_program);
+	delete_buffer(&sprite_instance_buffer);
+	delete_buffer(&sprite_row_mask_buffer);
+
+	delete_vertex_array(&empty_vertex_array);
+
+	//(PPUCaches -- in use or in free_caches -- are not deleted; a PPU466 might still be using one)
+}
+
+//make a vertex array object that tells the GPU the layout of (Vertex-format) data in 'buffer':
+// (and draws quads using quad_index_buffer)
+GLuint PPUDataStream::make_vertex_array_for_tile_program(GLuint buffer) const {
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
 
 	//Notice how this binding is attaching an integer input to a floating point attribute:
 	glVertexAttribPointer(
 		tile_program->Position_vec2, //attribute
 		2, //size
-		GL_INT, //type
+		GL_SHORT, //type
 		GL_FALSE, //normalized
 		sizeof(Vertex), //stride
 		(GLbyte *)0 + offsetof(Vertex, Position) //offset
@@ -380,7 +1067,7 @@ PPUDataStream::PPUDataStream() {
 	glVertexAttribIPointer(
 		tile_program->TileCoord_ivec2, //attribute
 		2, //size
-		GL_INT, //type
+		GL_UNSIGNED_BYTE, //type
 		sizeof(Vertex), //stride
 		(GLbyte *)0 + offsetof(Vertex, TileCoord) //offset
 	);
@@ -390,7 +1077,7 @@ PPUDataStream::PPUDataStream() {
 	glVertexAttribIPointer(
 		tile_program->Palette_int, //attribute
 		1, //size
-		GL_UNSIGNED_INT, //type
+		GL_UNSIGNED_SHORT, //type
 		sizeof(Vertex), //stride
 		(GLbyte *)0 + offsetof(Vertex, Palette) //offset
 	);
@@ -398,8 +1085,74 @@ PPUDataStream::PPUDataStream() {
 
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 
+	//the element array binding is part of the vertex array object's state:
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, quad_index_buffer);
+
+	glBindVertexArray(0);
+
+	return vao;
+}
+
+//make a vertex array object that feeds 'components' bytes per instance from 'buffer' to the instanced tile program:
+GLuint PPUDataStream::make_vertex_array_for_instanced_tile_program(GLuint buffer, GLint components) const {
+	GLuint vao = 0;
+	glGenVertexArrays(1, &vao);
+	glBindVertexArray(vao);
+
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+
+	//missing components (for background entries: z and w) are filled in as 0 and 1:
+	glVertexAttribIPointer(
+		instanced_tile_program->Instance_uvec4, //attribute
+		components, //size
+		GL_UNSIGNED_BYTE, //type
+		components, //stride
+		(GLbyte *)0 //offset
+	);
+	glEnableVertexAttribArray(instanced_tile_program->Instance_uvec4);
+	//advance once per instance instead of once per vertex:
+	glVertexAttribDivisor(instanced_tile_program->Instance_uvec4, 1);
+
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
 	glBindVertexArray(0);
 
+	return vao;
+}
+
+//A PPU466's tables and background are uploaded to its own PPUCache:
+PPUCache::PPUCache() {
+	//vertex_buffer holds the ring of sprite vertex segments, and is allocated once:
+	glGenBuffers(1, &vertex_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, vertex_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PPUDataStream::Vertex) * PPUDataStream::VertexSegmentSize * PPUDataStream::VertexSegments, nullptr, GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	vertex_buffer_for_tile_program = data_stream->make_vertex_array_for_tile_program(vertex_buffer);
+
+	//background_buffer holds one quad per background tile, and is allocated once and updated row-by-row:
+	glGenBuffers(1, &background_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, background_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(PPUDataStream::Vertex) * PPUDataStream::QuadVertices * PPU466::BackgroundWidth * PPU466::BackgroundHeight, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	background_buffer_for_tile_program = data_stream->make_vertex_array_for_tile_program(background_buffer);
+
+	//background_instance_buffer holds the background, and is allocated once and updated row-by-row:
+	glGenBuffers(1, &background_instance_buffer);
+	glBindBuffer(GL_ARRAY_BUFFER, background_instance_buffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(uint16_t) * PPU466::BackgroundWidth * PPU466::BackgroundHeight, nullptr, GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	background_instance_buffer_for_instanced_tile_program = data_stream->make_vertex_array_for_instanced_tile_program(background_instance_buffer, sizeof(uint16_t));
+
+
+	//background_tex holds the background, and is allocated once and updated row-by-row:
+	glGenTextures(1, &background_tex);
+	glBindTexture(GL_TEXTURE_2D, background_tex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R16UI, PPU466::BackgroundWidth, PPU466::BackgroundHeight, 0, GL_RED_INTEGER, GL_UNSIGNED_SHORT, nullptr);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D, 0);
 
 	glGenTextures(1, &tile_tex);
 	glBindTexture(GL_TEXTURE_2D, tile_tex);
@@ -428,25 +1181,5 @@ PPUDataStream::PPUDataStream() {
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glBindTexture(GL_TEXTURE_2D, 0);
 
-
 	GL_ERRORS();
 }
-
-PPUDataStream::~PPUDataStream() {
-	if (vertex_buffer_for_tile_program != 0) {
-		glDeleteVertexArrays(1, &vertex_buffer_for_tile_program);
-		vertex_buffer_for_tile_program = 0;
-	}
-	if (vertex_buffer != 0) {
-		glDeleteBuffers(1, &vertex_buffer);
-		vertex_buffer = 0;
-	}
-	if (tile_tex != 0) {
-		glDeleteTextures(1, &tile_tex);
-		tile_tex = 0;
-	}
-	if (palette_tex != 0) {
-		glDeleteTextures(1, &palette_tex);
-		palette_tex = 0;
-	}
-}
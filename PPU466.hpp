@@ -7,6 +7,9 @@
 
 #include <glm/glm.hpp>
 #include <array>
+#include <memory>
+
+struct PPUStats; //(see PPUStats.hpp)
 
 struct PPU466 {
 	PPU466();
@@ -18,6 +21,37 @@ struct PPU466 {
 	// pass the size of the current framebuffer in pixels so it knows how to scale itself
 	void draw(glm::uvec2 const &drawable_size) const;
 
+	//the PPU can get its state to the GPU in a few different ways (all produce the same image):
+	enum class DrawMethod : uint8_t {
+		Vertices, //sprites are streamed as quads every frame; background quads are kept on the GPU
+		Instanced, //sprites and background entries are uploaded as-is and expanded to quads by the GPU
+		FullscreenBackground, //sprites are instanced; the background is a texture looked up per-pixel (scrolling is free)
+	};
+	DrawMethod draw_method = DrawMethod::Vertices;
+
+	//if set, draw() records how long it took (per phase, on the CPU and GPU) and how much data it uploaded:
+	PPUStats *stats = nullptr;
+
+	//draw() keeps this PPU's tables and background on the GPU, and only uploads what changed since its last draw:
+	// copies of a PPU466 share those GPU-side copies (so drawing a copy -- e.g., a snapshot -- only uploads changes too),
+	// while separately constructed PPU466s each have their own (so drawing two PPUs doesn't re-upload both every frame)
+	struct GPUCache;
+	std::shared_ptr< GPUCache > gpu_cache;
+
+	//when you wish the PPU to draw *without* OpenGL (e.g., for tools or tests), render into memory instead:
+	// 'pixels' must point to ScreenWidth * ScreenHeight values, stored in rows from bottom-to-top (like glReadPixels)
+	// (produces the same image as draw() at 1x scale, with every pixel fully opaque;
+	//  where colors are blended, the GPU's rounding may differ by a step or two)
+	void render(glm::u8vec4 *pixels) const;
+
+	//render just scanlines [begin,end) into the corresponding rows of 'pixels':
+	void render_scanlines(uint32_t begin, uint32_t end, glm::u8vec4 *pixels) const;
+
+	//as above, but using sprites already sorted into scanlines by evaluate_sprites():
+	// (useful when rendering a frame in pieces, so sprite evaluation only happens once)
+	struct SpriteEvaluation;
+	void render_scanlines(uint32_t begin, uint32_t end, glm::u8vec4 *pixels, SpriteEvaluation const &evaluation) const;
+
 	//--------------------------------------------------------------
 	//Set the values below to control the PPU's drawing:
 
@@ -31,6 +65,9 @@ struct PPU466 {
 	//Background Color:
 	// The PPU clears the screen to the background color before other drawing takes place.
 	glm::u8vec3 background_color = glm::u8vec3(0x00, 0x00, 0x00);
+	// Set clear_screen to false to skip the clear and draw over whatever is already in the framebuffer:
+	//  (useful for overlays -- pixels that are transparent in the palette show what is underneath)
+	bool clear_screen = true;
 
 	//Palette:
 	// The PPU uses 2-bit indexed color;
@@ -140,4 +177,38 @@ struct PPU466 {
 	//  any sprites you don't want to use should be moved off the screen (y >= 240)
 	std::array< Sprite, 64 > sprites;
 
+	//Sprites Per Line:
+	// The NES PPU could only show 8 sprites on any one scanline;
+	//  any further sprites (in list order) were simply not drawn on that line.
+	// Set this to emulate that limit:
+	bool limit_sprites_per_line = false;
+	enum : uint32_t {
+		SpritesPerLine = 8
+	};
+	// (Games often pair the limit with "flicker" -- changing the sprite order every frame
+	//  so that the hidden sprites are different each time.)
+
+	//Sprite Evaluation:
+	// Before drawing, the PPU works out which sprites appear on each scanline,
+	//  culling off-screen sprites and (optionally) applying the sprites-per-line limit.
+	// You can run this yourself to find out what will be drawn (e.g., to see which sprites the limit hides):
+	struct SpriteEvaluation {
+		//sprites drawn on each scanline, as indices into 'sprites' in list order:
+		std::array< uint8_t, ScreenHeight > line_count;
+		std::array< std::array< uint8_t, std::tuple_size< decltype(sprites) >::value >, ScreenHeight > line_sprites;
+
+		//rows of each sprite that are drawn (bit r is set if row r is drawn; 0 means not drawn at all):
+		std::array< uint8_t, std::tuple_size< decltype(sprites) >::value > row_masks;
+
+		//Overflow:
+		// (reported whether or not limit_sprites_per_line is set, so you can tell what *would* be hidden)
+		//number of sprites beyond SpritesPerLine on each scanline:
+		std::array< uint8_t, ScreenHeight > line_overflow;
+		//rows of each sprite that are beyond the limit:
+		std::array< uint8_t, std::tuple_size< decltype(sprites) >::value > overflow_rows;
+		//number of scanlines with more than SpritesPerLine sprites:
+		uint32_t overflow_lines = 0;
+	};
+	void evaluate_sprites(SpriteEvaluation *evaluation) const;
+
 };
@@ -0,0 +1,171 @@
+//CPU-side parts of PPU466 (sprite evaluation and software rendering) -- these need no OpenGL context.
+
+#include "PPU466.hpp"
+#include "decode_tile.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PPU466_SOFTWARE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace {
+	//blend 'count' pixels of 'src' over 'dst' the same way draw() does (GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	// 'dst' is assumed to be opaque and stays that way.
+	void composite(glm::u8vec4 *dst, glm::u8vec4 const *src, uint32_t count) {
+		static_assert(sizeof(glm::u8vec4) == 4, "u8vec4 is packed");
+		uint32_t i = 0;
+#ifdef PPU466_SOFTWARE_SSE2
+		//four pixels at a time, as 16-bit values:
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i max = _mm_set1_epi16(255);
+		const __m128i half = _mm_set1_epi16(128);
+		const __m128i opaque = _mm_set1_epi32(int32_t(0xff000000));
+		for (; i + 4 <= count; i += 4) {
+			__m128i s = _mm_loadu_si128(reinterpret_cast< __m128i const * >(src + i));
+			__m128i d = _mm_loadu_si128(reinterpret_cast< __m128i * >(dst + i));
+
+			auto blend = [&](__m128i s16, __m128i d16) {
+				//copy each pixel's alpha to all four of its lanes:
+				__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s16, _MM_SHUFFLE(3,3,3,3)), _MM_SHUFFLE(3,3,3,3));
+				//s * a + d * (255 - a), then divide by 255 with rounding:
+				__m128i x = _mm_add_epi16(_mm_mullo_epi16(s16, a), _mm_mullo_epi16(d16, _mm_sub_epi16(max, a)));
+				x = _mm_add_epi16(x, half);
+				return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+			};
+			__m128i lo = blend(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+			__m128i hi = blend(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+		}
+#endif
+		for (; i < count; ++i) {
+			uint32_t a = src[i].a;
+			if (a == 0xff) {
+				dst[i] = glm::u8vec4(src[i].r, src[i].g, src[i].b, 0xff);
+			} else if (a != 0x00) {
+				for (uint32_t c = 0; c < 3; ++c) {
+					uint32_t x = src[i][c] * a + dst[i][c] * (255 - a) + 128;
+					dst[i][c] = uint8_t((x + (x >> 8)) >> 8);
+				}
+			}
+		}
+	}
+
+	//look up the colors of a decoded tile row:
+	void colorize(uint8_t const indices[8], PPU466::Palette const &palette, glm::u8vec4 colors[8]) {
+		for (uint32_t x = 0; x < 8; ++x) {
+			colors[x] = palette[indices[x]];
+		}
+	}
+}
+
+void PPU466::evaluate_sprites(SpriteEvaluation *evaluation_) const {
+	assert(evaluation_);
+	auto &evaluation = *evaluation_;
+
+	evaluation.line_count.fill(0);
+	evaluation.line_overflow.fill(0);
+	evaluation.row_masks.fill(0);
+	evaluation.overflow_rows.fill(0);
+	evaluation.overflow_lines = 0;
+
+	for (uint32_t i = 0; i < sprites.size(); ++i) {
+		Sprite const &sprite = sprites[i];
+		if (sprite.y >= ScreenHeight) continue; //off-screen
+
+		//rows that hang off the top of the screen are never drawn:
+		uint32_t rows = std::min(8U, ScreenHeight - sprite.y);
+		for (uint32_t r = 0; r < rows; ++r) {
+			uint32_t y = sprite.y + r;
+
+			//sprites already on this line (including any hidden by the limit):
+			uint32_t seen = evaluation.line_count[y] + (limit_sprites_per_line ? evaluation.line_overflow[y] : 0);
+			if (seen >= SpritesPerLine) {
+				if (evaluation.line_overflow[y] == 0) evaluation.overflow_lines += 1;
+				evaluation.line_overflow[y] += 1;
+				evaluation.overflow_rows[i] |= uint8_t(1 << r);
+				if (limit_sprites_per_line) continue;
+			}
+
+			evaluation.line_sprites[y][evaluation.line_count[y]++] = uint8_t(i);
+			evaluation.row_masks[i] |= uint8_t(1 << r);
+		}
+	}
+}
+
+void PPU466::render(glm::u8vec4 *pixels) const {
+	render_scanlines(0, ScreenHeight, pixels);
+}
+
+void PPU466::render_scanlines(uint32_t begin, uint32_t end, glm::u8vec4 *pixels) const {
+	SpriteEvaluation evaluation;
+	evaluate_sprites(&evaluation);
+	render_scanlines(begin, end, pixels, evaluation);
+}
+
+void PPU466::render_scanlines(uint32_t begin, uint32_t end, glm::u8vec4 *pixels, SpriteEvaluation const &evaluation) const {
+	assert(begin <= end && end <= ScreenHeight);
+
+	constexpr int32_t BackgroundWidthPixels = int32_t(BackgroundWidth) * 8;
+	constexpr int32_t BackgroundHeightPixels = int32_t(BackgroundHeight) * 8;
+
+	for (uint32_t y = begin; y < end; ++y) {
+		glm::u8vec4 *row = pixels + ScreenWidth * y;
+
+		//background gets background color:
+		std::fill(row, row + ScreenWidth, glm::u8vec4(background_color, 0xff));
+
+		//helper to draw the part of each sprite on this scanline (in order):
+		auto draw_sprites = [this,y,row,&evaluation](uint8_t priority) {
+			for (uint32_t i = 0; i < evaluation.line_count[y]; ++i) {
+				Sprite const &sprite = sprites[evaluation.line_sprites[y][i]];
+				if ((sprite.attributes & 0x80) != priority) continue;
+
+				Tile const &tile = tile_table[sprite.index];
+				uint32_t ty = y - sprite.y;
+				uint8_t indices[8];
+				decode_tile_row(tile.bit0[ty], tile.bit1[ty], indices);
+				glm::u8vec4 colors[8];
+				colorize(indices, palette_table[sprite.attributes & 0x07], colors);
+
+				//sprites hanging off the right edge are clipped:
+				composite(row + sprite.x, colors, std::min(8U, ScreenWidth - sprite.x));
+			}
+		};
+
+		draw_sprites(0x80); //draw sprites with priority == 1 ('behind' sprites)
+
+		{ //draw the background, one tile-row span at a time:
+			//background pixel under the start of this scanline (wrapping around):
+			int32_t by = ((int32_t(y) - background_position.y) % BackgroundHeightPixels + BackgroundHeightPixels) % BackgroundHeightPixels;
+			int32_t bx = ((0 - background_position.x) % BackgroundWidthPixels + BackgroundWidthPixels) % BackgroundWidthPixels;
+
+			uint16_t const *background_row = background.data() + BackgroundWidth * (by / 8);
+			uint32_t ty = uint32_t(by % 8);
+
+			for (uint32_t x = 0; x < ScreenWidth; ) {
+				uint16_t info = background_row[bx / 8];
+				Tile const &tile = tile_table[info & 0xff]; //extract tile index bits
+
+				uint8_t indices[8];
+				decode_tile_row(tile.bit0[ty], tile.bit1[ty], indices);
+				glm::u8vec4 colors[8];
+				colorize(indices, palette_table[(info >> 8) & 0x07], colors); //extract palette index bits
+
+				//span covers the rest of this tile (or the rest of the screen):
+				uint32_t tx = uint32_t(bx % 8);
+				uint32_t count = std::min(8 - tx, ScreenWidth - x);
+				composite(row + x, colors + tx, count);
+
+				x += count;
+				bx = (bx + int32_t(count)) % BackgroundWidthPixels;
+			}
+		}
+
+		draw_sprites(0x00); //draw sprites with priority == 0 ('in front' sprites)
+	}
+}
@@ -0,0 +1,86 @@
+#include "PPURenderPool.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+PPURenderPool::PPURenderPool(uint32_t threads) {
+	if (threads == 0) {
+		//hardware_concurrency() may return 0 if it doesn't know:
+		threads = std::max(1U, std::thread::hardware_concurrency()) - 1;
+	}
+
+	workers.reserve(threads);
+	for (uint32_t i = 0; i < threads; ++i) {
+		workers.emplace_back([this](){
+			uint64_t seen = 0;
+			while (true) {
+				{ //wait for a frame we haven't worked on yet:
+					std::unique_lock< std::mutex > lock(mutex);
+					start_cv.wait(lock, [&](){ return quit || frame != seen; });
+					if (quit) return;
+					seen = frame;
+				}
+				render_bands();
+			}
+		});
+	}
+}
+
+PPURenderPool::~PPURenderPool() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	start_cv.notify_all();
+	for (auto &worker : workers) {
+		worker.join();
+	}
+}
+
+void PPURenderPool::render(PPU466 const &ppu_, glm::u8vec4 *pixels_) {
+	//sort sprites into scanlines:
+	ppu_.evaluate_sprites(&evaluation);
+
+	//start the frame:
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		ppu = &ppu_;
+		pixels = pixels_;
+		next_band = 0;
+		bands_done = 0;
+		frame += 1;
+	}
+	start_cv.notify_all();
+
+	//help out:
+	render_bands();
+
+	//wait for any bands still being rendered by workers:
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		done_cv.wait(lock, [this](){ return bands_done == BandCount; });
+		ppu = nullptr;
+		pixels = nullptr;
+	}
+}
+
+void PPURenderPool::render_bands() {
+	uint32_t finished = 0;
+	while (true) {
+		uint32_t b = next_band.fetch_add(1);
+		if (b >= BandCount) break;
+
+		uint32_t begin = b * BandHeight;
+		uint32_t end = std::min< uint32_t >(begin + BandHeight, PPU466::ScreenHeight);
+		ppu->render_scanlines(begin, end, pixels, evaluation);
+		finished += 1;
+	}
+
+	if (finished == 0) return;
+
+	//the thread that finishes the last band wakes up render():
+	if (bands_done.fetch_add(finished) + finished == BandCount) {
+		std::unique_lock< std::mutex > lock(mutex);
+		done_cv.notify_all();
+	}
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+/*
+ * PPURenderPool -- renders PPU466 state on the CPU using several threads.
+ *
+ * The screen is split into bands of scanlines; worker threads (and the calling thread)
+ *  take bands one at a time until the frame is done.
+ * Before a frame starts, sprites are sorted into scanlines (PPU466::evaluate_sprites) so each band
+ *  only looks at the sprites that overlap it.
+ *
+ * Produces exactly the same image as PPU466::render().
+ *
+ * Usage:
+ *  PPURenderPool pool; //start worker threads once
+ *  std::vector< glm::u8vec4 > pixels(PPU466::ScreenWidth * PPU466::ScreenHeight);
+ *  for (...) {
+ *      pool.render(ppu, pixels.data()); //returns when the frame is complete
+ *  }
+ *
+ */
+
+#include "PPU466.hpp"
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+struct PPURenderPool {
+	//starts 'threads' worker threads (0 means "one per hardware thread, minus the caller"):
+	explicit PPURenderPool(uint32_t threads = 0);
+	~PPURenderPool();
+
+	PPURenderPool(PPURenderPool const &) = delete;
+	PPURenderPool &operator=(PPURenderPool const &) = delete;
+
+	//render 'ppu' into 'pixels' (ScreenWidth * ScreenHeight values, rows from bottom-to-top, same as PPU466::render):
+	// not safe to call from more than one thread at once
+	void render(PPU466 const &ppu, glm::u8vec4 *pixels);
+
+	//the screen is split into bands of this many scanlines:
+	enum : uint32_t {
+		BandHeight = 8,
+		BandCount = (PPU466::ScreenHeight + BandHeight - 1) / BandHeight,
+	};
+
+	//number of worker threads (not counting the thread calling render()):
+	uint32_t thread_count() const { return uint32_t(workers.size()); }
+
+private:
+	//sprites sorted into scanlines, shared by all bands:
+	PPU466::SpriteEvaluation evaluation;
+
+	//render bands until there are none left:
+	void render_bands();
+
+	//the frame currently being rendered:
+	PPU466 const *ppu = nullptr;
+	glm::u8vec4 *pixels = nullptr;
+	std::atomic< uint32_t > next_band{0}; //next band to hand out
+	std::atomic< uint32_t > bands_done{0}; //bands finished so far
+
+	//worker threads wait for a new 'frame' number (or 'quit'):
+	std::mutex mutex;
+	std::condition_variable start_cv; //signalled when a frame is ready
+	std::condition_variable done_cv; //signalled when the last band finishes
+	uint64_t frame = 0;
+	bool quit = false;
+
+	std::vector< std::thread > workers;
+};
@@ -0,0 +1,172 @@
+#include "PPUStats.hpp"
+
+#include "GL.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+
+PPUStats::PPUStats(uint32_t capacity) {
+	assert(capacity > 0);
+	frames.resize(capacity);
+}
+
+PPUStats::~PPUStats() {
+	for (auto &query : queries) {
+		if (query.id != 0) {
+			glDeleteQueries(1, &query.id);
+			query.id = 0;
+		}
+	}
+}
+
+char const *PPUStats::phase_name(uint32_t phase) {
+	switch (phase) {
+		case Setup: return "setup";
+		case Tables: return "tables";
+		case Sprites: return "sprites";
+		case Background: return "background";
+		case Draw: return "draw";
+		case Total: return "cpu_total";
+		case GPU: return "gpu";
+	}
+	return "unknown";
+}
+
+float PPUStats::Frame::cpu_total_ms() const {
+	float total = 0.0f;
+	for (float ms : cpu_ms) total += ms;
+	return total;
+}
+
+PPUStats::Summary PPUStats::summary(uint32_t phase) const {
+	//gather samples:
+	std::vector< float > values;
+	values.reserve(count);
+	for (uint32_t i = 0; i < count; ++i) {
+		Frame const &f = frame(i);
+		if (phase < PhaseCount) values.emplace_back(f.cpu_ms[phase]);
+		else if (phase == Total) values.emplace_back(f.cpu_total_ms());
+		else if (phase == GPU && f.gpu_ms >= 0.0f) values.emplace_back(f.gpu_ms);
+	}
+
+	Summary ret;
+	ret.samples = uint32_t(values.size());
+	if (values.empty()) return ret;
+
+	double sum = 0.0;
+	for (float v : values) sum += v;
+	ret.mean = float(sum / values.size());
+
+	//nearest-rank percentiles:
+	std::sort(values.begin(), values.end());
+	auto percentile = [&values](float p) {
+		size_t rank = size_t(std::ceil(p / 100.0f * values.size()));
+		return values[std::min(values.size(), std::max< size_t >(rank, 1)) - 1];
+	};
+	ret.p50 = percentile(50.0f);
+	ret.p95 = percentile(95.0f);
+	ret.p99 = percentile(99.0f);
+	ret.max = values.back();
+
+	return ret;
+}
+
+bool PPUStats::write_csv(std::string const &filename) const {
+	std::ofstream out(filename, std::ios::binary);
+	if (!out) return false;
+
+	out << "frame";
+	for (uint32_t p = 0; p < PhaseCount; ++p) {
+		out << ',' << phase_name(p) << "_ms";
+	}
+	out << ",cpu_total_ms,gpu_ms,vertices,upload_bytes\n";
+
+	for (uint32_t i = 0; i < count; ++i) {
+		Frame const &f = frame(i);
+		out << f.index;
+		for (float ms : f.cpu_ms) {
+			out << ',' << ms;
+		}
+		out << ',' << f.cpu_total_ms() << ',';
+		if (f.gpu_ms >= 0.0f) out << f.gpu_ms; //(left empty if unknown)
+		out << ',' << f.vertices << ',' << f.upload_bytes << '\n';
+	}
+
+	return bool(out);
+}
+
+void PPUStats::clear() {
+	next = 0;
+	count = 0;
+}
+
+void PPUStats::begin_frame() {
+	assert(!current && "frames shouldn't nest");
+	current = &frames[next];
+	*current = Frame();
+	current->index = frames_recorded;
+	last_mark = std::chrono::high_resolution_clock::now();
+}
+
+void PPUStats::mark(Phase phase) {
+	if (!current) return;
+	auto now = std::chrono::high_resolution_clock::now();
+	current->cpu_ms[phase] += std::chrono::duration< float, std::milli >(now - last_mark).count();
+	last_mark = now;
+}
+
+void PPUStats::end_frame() {
+	assert(current && "end_frame() without begin_frame()");
+	current = nullptr;
+	next = (next + 1) % frames.size();
+	count = std::min(count + 1, frames.size());
+	frames_recorded += 1;
+}
+
+void PPUStats::begin_gpu_timer() {
+	assert(!active_query && "GPU timers shouldn't nest");
+
+	collect_gpu_results();
+
+	//if the GPU is so far behind that every query is still in flight, just skip timing this frame:
+	Query &query = queries[next_query];
+	if (query.pending) return;
+
+	if (query.id == 0) glGenQueries(1, &query.id);
+	glBeginQuery(GL_TIME_ELAPSED, query.id);
+	query.frame = frames_recorded;
+	query.pending = true;
+	active_query = &query;
+	next_query = (next_query + 1) % queries.size();
+}
+
+void PPUStats::end_gpu_timer() {
+	if (!active_query) return;
+	glEndQuery(GL_TIME_ELAPSED);
+	active_query = nullptr;
+}
+
+void PPUStats::collect_gpu_results() {
+	for (auto &query : queries) {
+		if (!query.pending) continue;
+
+		GLint available = GL_FALSE;
+		glGetQueryObjectiv(query.id, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (!available) continue;
+
+		GLuint64 ns = 0;
+		glGetQueryObjectui64v(query.id, GL_QUERY_RESULT, &ns);
+		query.pending = false;
+
+		//store the result if the frame is still in the ring:
+		// (the slot may have been reused -- possibly by the frame in progress -- so check its index)
+		if (query.frame < frames_recorded && frames_recorded - query.frame <= count) {
+			Frame &f = frames[(next + frames.size() - (frames_recorded - query.frame)) % frames.size()];
+			if (f.index == query.frame) {
+				f.gpu_ms = float(double(ns) / 1.0e6);
+			}
+		}
+	}
+}
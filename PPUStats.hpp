@@ -0,0 +1,114 @@
+#pragma once
+
+/*
+ * PPUStats -- timing and traffic statistics for PPU466::draw().
+ *
+ * Point a PPU466 at a PPUStats and every draw() will record a Frame:
+ *   PPUStats stats;
+ *   ppu.stats = &stats;
+ *   ...
+ *   ppu.draw(drawable_size);
+ *   std::cout << stats.summary(PPUStats::Total).p99 << std::endl;
+ *   stats.write_csv("ppu-stats.csv");
+ *
+ * CPU time is measured per phase of draw() with std::chrono.
+ * GPU time is measured with GL_TIME_ELAPSED queries; results arrive a few frames late
+ *  (they are never waited for), so the most recent frames will not have a GPU time yet.
+ *
+ */
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+struct PPUStats {
+	//keeps the most recent 'capacity' frames:
+	explicit PPUStats(uint32_t capacity = 600);
+	~PPUStats(); //NOTE: frees GL query objects, so should be destroyed while the GL context is still around
+
+	PPUStats(PPUStats const &) = delete;
+	PPUStats &operator=(PPUStats const &) = delete;
+
+	//the parts of PPU466::draw() that are timed:
+	enum Phase : uint32_t {
+		Setup, //viewport, clear, and sprite evaluation
+		Tables, //decoding and uploading changed tiles and palettes
+		Sprites, //building and uploading sprite vertices / instances
+		Background, //uploading changed background rows
+		Draw, //issuing draw calls
+		PhaseCount,
+		Total = PhaseCount, //(for summary(): the sum of all phases)
+		GPU, //(for summary(): GPU time)
+	};
+	static char const *phase_name(uint32_t phase);
+
+	struct Frame {
+		uint64_t index = 0; //number of frames recorded before this one
+		std::array< float, PhaseCount > cpu_ms{}; //CPU milliseconds spent in each phase
+		float gpu_ms = -1.0f; //GPU milliseconds (negative if not known [yet])
+		uint32_t vertices = 0; //vertices processed by the GPU (including instanced quads and background copies)
+		uint32_t upload_bytes = 0; //bytes of buffer and texture data sent to the GPU
+
+		float cpu_total_ms() const;
+	};
+
+	//recorded frames, oldest first:
+	uint32_t size() const { return uint32_t(count); }
+	Frame const &frame(uint32_t i) const { return frames[(next + frames.size() - count + i) % frames.size()]; }
+
+	//rolling statistics over recorded frames (phase may be a Phase, Total, or GPU):
+	struct Summary {
+		uint32_t samples = 0;
+		float mean = 0.0f;
+		float p50 = 0.0f;
+		float p95 = 0.0f;
+		float p99 = 0.0f;
+		float max = 0.0f;
+	};
+	Summary summary(uint32_t phase) const;
+
+	//write all recorded frames as comma-separated values (one row per frame), returns false on failure:
+	bool write_csv(std::string const &filename) const;
+
+	//forget all recorded frames:
+	void clear();
+
+	//--------------------------------------------------------------
+	//used by PPU466::draw():
+
+	//start a new frame; phase timing starts now:
+	void begin_frame();
+	//charge time since the last mark (or begin_frame) to 'phase':
+	void mark(Phase phase);
+	//count traffic for the current frame:
+	void count_upload(size_t bytes) { if (current) current->upload_bytes += uint32_t(bytes); }
+	void count_vertices(size_t vertices) { if (current) current->vertices += uint32_t(vertices); }
+	//finish the current frame:
+	void end_frame();
+
+	//GPU timing (requires a current GL context), brackets the GL work of the current frame:
+	void begin_gpu_timer();
+	void end_gpu_timer();
+
+private:
+	std::vector< Frame > frames; //ring buffer
+	size_t next = 0; //slot for the next frame
+	size_t count = 0; //frames recorded (up to frames.size())
+	uint64_t frames_recorded = 0;
+
+	Frame *current = nullptr;
+	std::chrono::high_resolution_clock::time_point last_mark;
+
+	//GL_TIME_ELAPSED queries in flight:
+	struct Query {
+		uint32_t id = 0; //GL query object name
+		uint64_t frame = 0; //frame index being timed
+		bool pending = false; //waiting on a result
+	};
+	std::array< Query, 4 > queries;
+	uint32_t next_query = 0;
+	Query *active_query = nullptr;
+	void collect_gpu_results(); //read any finished queries (never blocks)
+};
@@ -1,6 +1,8 @@
 #include "PlayMode.hpp"
 #include "Load.hpp"
-#include "load_save_png.hpp"
+#include "data_path.hpp"
+#include "AssetPack.hpp"
+#include "read_write_chunk.hpp"
 
 //for the GL_ERRORS() macro:
 #include "gl_errors.hpp"
@@ -30,6 +32,15 @@ struct GameObject {
 	std::array<uint8_t, 2> width_radius; // left, right
 	std::array<uint8_t, 2> height_radius; // up, down
 	std::array<uint8_t, 2> sprite_center; // "software" sprite, bl corner is (0, 0)
+
+	// position at the start of the most recent update step (for interpolating when drawing)
+	std::array<float, 2> previous_position = {0, 0};
+
+	// position to draw, 'alpha' of the way from the previous position to the current one
+	std::array<float, 2> drawn_position(float alpha) const {
+		return {previous_position[0] + (position[0] - previous_position[0]) * alpha,
+				previous_position[1] + (position[1] - previous_position[1]) * alpha};
+	}
 };
 
 struct PhysicsObject {
@@ -118,8 +129,6 @@ std::array<PPU466::Sprite, 16> gemSprites; // there will be at most 4 gems in pl
 std::vector<PPU466::Sprite> enemySprites; // vector since this can be variable (though bounded by 12)
 std::vector<PPU466::Sprite> bulletSprites; // vector since this can be variable
 
-PPU466 ppu = PPU466();
-
 /*************
  * Game Logic
  *************/
@@ -142,270 +151,35 @@ Gemstar gemstar;
 std::vector<Enemy> enemies;
 std::vector<Bullet> bullets;
 
-int color_compare(glm::uvec4 color_a, glm::uvec4 color_b) {
-	for (int i = 0; i < 4; i++) {
-		if (color_a[i] < color_b[i])
-			return -1;
-		else if (color_a[i] > color_b[i])
-			return 1;
-	}
-	return 0;
-}
-bool palette_match(std::vector<glm::u8vec4> colors, std::vector<glm::u8vec4> cmpPalette) {
-	if (colors.size() > cmpPalette.size()) {
-		// check if colors is a strict superset
-		for (uint8_t p = 0; p < cmpPalette.size(); p++) {
-			bool color_found = false;
-			for (uint8_t c = 0; c < colors.size(); c++) {
-				if (colors[c] == cmpPalette[p])
-					color_found = true;
-			}
-			if (!color_found)
-				return false;
-		}
-		return true;
-	}
-	else {
-		// check if colors is a strict subset of cmpPalette
-		// or if colors and cmpPalette match
-		for (uint8_t c = 0; c < colors.size(); c++) {
-			bool color_found = false;
-			for (uint8_t p = 0; p < cmpPalette.size(); p++) {
-				if (colors[c] == cmpPalette[p])
-					color_found = true;
-			}
-			if (!color_found)
-				return false;
-		}
-		return true;
-	}
-}
-
 /*****************************
- * Asset Pipeline Functions
+ * Asset Pipeline
  *****************************/
-void process_tiles() {
-	/***********************************************************************************
-	 * TILES
-	 * Based on code provided by Jim McCann.
-	 * 
-	 * 1) Scan and get spritesheet data into an array
-	 * 2) Do index math to get "png tiles" (8x8 blocks)
-	 * 3) Calculate Palette Indices from colors:
-	 *    a) put tiles into buckets based on colors found
-	 *    b) if a tile has no conflicting colors with a bucket,
-	 *       it goes in that bucket (bucket gets updated). Create buckets as needed
-	 *    c) Go through each bucket and assign each color a number 0-3
-	 * 		 (transparent (0xeeeeee) is 0, 1-3 are sorted smallest hex value to largest)
-	 *    d) Create tiles based on number
-	 *    e) (if time) create flipped versions of tiles?
-	************************************************/
-
-	//1) Scan for data
-	const uint64_t spritesheet_dimensions = 64*48;
-	const uint64_t tile_count = 46;
-	// const uint64_t true_pixel_count = (64*48);
-	glm::uvec2 *spritesheet_size = new glm::uvec2(64, 48);
-	std::vector< glm::u8vec4 > raw_tile_pixels;
-
-	// ColoredTile holds color info rather than palette index info (we'll use it to construct the palette info for the tile)
-	std::array< ColoredTile, tile_count > colored_tiles;
-	load_png("assets/spritesheet.png", spritesheet_size, &raw_tile_pixels, OriginLocation::UpperLeftOrigin);
-
-	// 2) Index math
-	for (uint64_t r = 0; r < spritesheet_dimensions / 8; r++) {
-		// 8-pixel row by 8-pixel row, assign to the right tile
-		std::array< glm::u8vec4, 8 > pixel_row;
-		
-		// go across the pixels and get the row
-		for (int p = 0; p < 8; p++) {
-			pixel_row[p] = raw_tile_pixels[(8 * r) + p];
-		}
-
-		// then, assign the pixel row to the right tile:
-		// get the row and the column it belongs in on the tbale
-		// then calculate the index in the table tile
-		uint64_t table_row = r / 64;
-		uint64_t table_col = r % 8;
-		uint64_t table_idx = (table_row * 8) + table_col;
-
-		if (table_idx < tile_count) {
-			uint64_t row_num = (r / 8) % 8; // row in the tile
-			colored_tiles[table_idx][row_num] = pixel_row;
+// everything the game loads (see AssetPack.hpp; Maekfile.js builds dist/assets.pack with pack-assets):
+Load< AssetPack > game_assets(LoadAfter{}, LoadThreaded, []() -> AssetPack * {
+	return new AssetPack(data_path("assets.pack"));
+});
+
+// tiles + palettes compiled from assets/spritesheet.png and assets/palettes.png by compile-tiles
+// (see compile-tiles.cpp; Maekfile.js re-runs it whenever either png changes)
+struct SpritesheetTiles {
+	SpritesheetTiles(std::span< char const > bytes) {
+		map_chunk(&bytes, "tile", &tiles);
+		map_chunk(&bytes, "pale", &palettes);
+		if (tiles.size() > sizeof(PPU466::tile_table) / sizeof(PPU466::Tile)
+		 || palettes.size() > sizeof(PPU466::palette_table) / sizeof(PPU466::Palette)) {
+			throw std::runtime_error("spritesheet.tiles has more tiles or palettes than PPU466 does.");
 		}
 	}
 
-	// DEBUG print tiles
-	// for (uint64_t i = 0; i < tile_count; i++) {
-	// 	ColoredTile tile = colored_tiles[i];
-	// 	printf("TILE %llu:\n", i);
-	// 	for (uint64_t r = 0; r < 8; r++) {
-	// 		printf("{");
-	// 		std::array<glm::u8vec4, 8> row = tile[r];
-	// 		for (uint64_t c = 0; c < 8; c++) {
-	// 			printf("(%x, %x, %x, %x) ~ ", row[c].x, row[c].y, row[c].z, row[c].w);
-	// 		}
-	// 		printf("}\n");
-	// 	}
-
-	// 	printf("\n");
-	// }
-
-	// 3) Palette indices
-	// mapping of rgba -> number is a bucket
-	std::array<PaletteBucket, tile_count> palette_buckets;
-	std::unordered_map< uint64_t, uint64_t > tile_palette_map = {}; // used to assign palette indices (color index to palette index)
-	uint64_t buckets_made = 0;
-	for (uint64_t t = 0; t < tile_count; t++) {
-		ColoredTile tile = colored_tiles[t];
-
-		// a) get the colors of the tile
-		std::unordered_set<uint32_t> colors; 
-		for (auto row : tile) {
-			for (uint8_t p = 0; p < 8; p++)
-				colors.emplace((row[p].x << 24) + (row[p].y << 16) + (row[p].z << 8) + row[p].w);
-		}
-		std::vector<glm::u8vec4> color_keys = {};
-		for (uint32_t color : colors) {
-			color_keys.emplace_back(glm::u8vec4((color >> 24) & 0xff,
-									 			(color >> 16) & 0xff,
-									 			(color >> 8) & 0xff,
-									  			 color & 0xff));
-		}
-
-		// DEBUG what colors were found?
-		// printf("Found %llu colors in tile %llu: { ~ ", color_keys.size(), t);
-		// for (int i = 0; i < color_keys.size(); i++) {
-		// 	printf("(%u, %u, %u, %u) ~ ", color_keys[i].x, color_keys[i].y, color_keys[i].z, color_keys[i].w);
-		// }
-		// printf("}\n");
-
-		// b) determine which PaletteBucket it goes in, and add to the tile_palette_map
-		//	  (update buckets as necessary)
-
-		// to compare palettes against the current
-		// std::vector<PaletteBucket> palettes;
-		// for (auto [key, bucket] : tile_palette_map) {
-		// 	palettes.emplace_back(bucket);
-		// }
-		
-		// compare `colors` to each palette
-		bool bucket_found = false;
-		for (uint64_t p = 0; p < palette_buckets.size(); p++) {
-			PaletteBucket bucket = palette_buckets[p];
-
-			if (bucket.size() > 0) {
-				std::vector<glm::u8vec4> cmpPalette = {};
-				for (auto color_vec : bucket) {
-					cmpPalette.emplace_back(color_vec);
-				}
-
-				if (palette_match(color_keys, cmpPalette)) // first palette to match, map
-				{
-					bucket_found = true;
-					// the larger palette is what the tiles are mapped to
-					if (cmpPalette.size() < colors.size())
-					{
-						// update the bucket with the colors in `colors`
-						// for (auto color : colors) {
-							palette_buckets[p] = color_keys;
-							// uint32_t color_bytes = (color[0] << 24) + (color[1] << 16) + (color[2] << 8) + color[3];
-							// bucket[color_bytes] = (uint8_t)bucket.size();
-				// 		}
-					}
-					tile_palette_map[t] = p;
-					break;
-				}
-			}
-		}
-
-		if (!bucket_found) {
-			palette_buckets[buckets_made] = color_keys;
-			tile_palette_map[t] = buckets_made;
-			buckets_made++;
-		}
-	}
-
-	for (uint64_t b = 0; b < buckets_made; b++) {
-		PaletteBucket bucket = palette_buckets[b];
-		// c) Go through each bucket and reassign numbers
-		// get keys
-		// std::vector<glm::u8vec4> keys;
-		// for (auto [color, num] : bucket) {
-		// 	keys.emplace_back(color);
-		// }
-
-		// sort and remap
-		for (uint8_t i = 0; i < 3; i++) {
-			for (uint8_t j = i; j < 4; j++) {
-				if (color_compare(bucket[j], bucket[i]) < 0 || (bucket[j].x == 0xee && bucket[j].y == 0xee && bucket[j].z == 0xee)) {
-					glm::uvec4 temp = bucket[i];
-					bucket[i] = bucket[j];
-					bucket[j] = temp;
-				}
-			}
-			// uint32_t color_bytes = (keys[i][3] << 24) + (keys[i][2] << 16) + (keys[i][1] << 8) + keys[i][0];
-			// bucket[color_bytes] = i;
-		}
-	}
-
-
-	for (uint64_t t = 0; t < tile_count; t++) {
-		// static_assert(tile_palette_map.contains(tile_colors[t]), "Colored tile %lu was added to the tp map");
-		// d) construct tile
-		ColoredTile tile = colored_tiles[t];
-		uint64_t palette_index = tile_palette_map[t];
-		// printf("Tile %zu -> Palette %zu.\n", t, palette_index);
-		PaletteBucket palette_bucket = palette_buckets[palette_index]; // color->int
-
-		for (uint64_t y = 0; y < 8; y++) {
-			std::array< glm::u8vec4, 8 > tile_row = tile[y];
-			uint8_t row_bit_0 = 0;
-			uint8_t row_bit_1 = 0;
-			for (uint64_t x = 0; x < 8; x++) {
-				glm::u8vec4 color = tile_row[x];
-				// uint32_t color_bytes = (tile_row[x][3] << 24) + (tile_row[x][2] << 16) + (tile_row[x][1] << 8) + tile_row[x][0];
-
-				uint8_t palette_idx = 0;
-				for (uint8_t i = 0; i < palette_bucket.size(); i++)
-					if (color_compare(color, palette_bucket[i]) == 0)
-						palette_idx = i;
-				// printf("Mapped color (%zu, %zu) -> palette index %u\n", x, y, palette_idx);
-
-				// (x,y) -> color -> palette_idx (from PaletteBucket)
-				row_bit_0 += (palette_idx % 2) << (7 - x);
-				row_bit_1 += (palette_idx / 2) << (7 - x);
-			}
-			ppu.tile_table[t].bit0[y] = row_bit_0;
-			ppu.tile_table[t].bit1[y] = row_bit_1;
-		}
-		// printf("\n");
-	}
+	//tiles + palettes point directly into game_assets' mapped file:
+	std::span< PPU466::Tile const > tiles;
+	std::span< PPU466::Palette const > palettes;
+};
 
-}
-void process_palettes() {
-	/*********************************************************************************
-	 * PALETTES
-	 * Palettes are also pngs, use load_png to convert to color format.
-	 * Assumes palette is already sorted
-	 * (with the exception of "eeeeee" leading if present,
-	 *  as that marks transparency)
-	 *********************************************************************************/
-	glm::uvec2 *palette_sheet_size = new glm::uvec2(4, 8);
-	std::vector< glm::u8vec4 > palette_data;
-
-	load_png("assets/palettes.png", palette_sheet_size, &palette_data, OriginLocation::UpperLeftOrigin);
-	for (uint64_t i = 0; i < palette_data.size(); i++) {
-		uint64_t pal_tbl_idx = i / 4;
-		uint64_t pal_idx = i % 4;
-
-		if (pal_idx == 0 && palette_data[i][0] == 0xee && palette_data[i][1] == 0xee && palette_data[i][2] == 0xee)
-			ppu.palette_table[pal_tbl_idx][0] = {0x00, 0x00, 0x00, 0x00};
-		else
-			ppu.palette_table[pal_tbl_idx][pal_idx] = palette_data[i];
-	}
+Load< SpritesheetTiles > spritesheet_tiles(LoadAfter{ game_assets }, LoadThreaded, []() -> SpritesheetTiles * {
+	return new SpritesheetTiles(game_assets->get("spritesheet.tiles"));
+});
 
-}
 void create_player_sprites() {
 	for (uint8_t i = 0; i < 4; i++)
 		playerSprites[i].index = i; // head, body, gemstar, reticle
@@ -417,10 +191,9 @@ void create_player_sprites() {
 }
 
 PlayMode::PlayMode() {
-	//Asset Pipeline
-	process_tiles();
-	process_palettes();
-
+	//Asset Pipeline (tiles + palettes were made by compile-tiles at build time)
+	std::copy(spritesheet_tiles->tiles.begin(), spritesheet_tiles->tiles.end(), ppu.tile_table.begin());
+	std::copy(spritesheet_tiles->palettes.begin(), spritesheet_tiles->palettes.end(), ppu.palette_table.begin());
 
 	/**********************************
 	 * Sprite (entity) lists
@@ -429,6 +202,11 @@ PlayMode::PlayMode() {
 	for (int i = 0; i < 4; i++)
 		ppu.sprites[i] = playerSprites[i];
 	
+	// nothing to interpolate from yet
+	player.gameObject.previous_position = player.gameObject.position;
+
+	//record how long the PPU takes to draw:
+	ppu.stats = &ppu_stats;
 }
 
 PlayMode::~PlayMode() {
@@ -453,6 +231,24 @@ bool PlayMode::handle_event(SDL_Event const &evt, glm::uvec2 const &window_size)
 			down.downs += 1;
 			down.pressed = true;
 			return true;
+		} else if (evt.key.key == SDLK_F2) {
+			//print a summary of PPU draw timings and dump them all to a file:
+			if (snapshotting) {
+				std::cout << "PPU draw timings aren't recorded while the simulation runs on its own thread (leave out --threaded-sim to record them)." << std::endl;
+				return true;
+			}
+			std::cout << "PPU draw timings (ms) over the last " << ppu_stats.size() << " frames:\n";
+			for (uint32_t p = 0; p <= PPUStats::GPU; ++p) {
+				PPUStats::Summary summary = ppu_stats.summary(p);
+				std::cout << "  " << PPUStats::phase_name(p) << ": mean " << summary.mean << ", p50 " << summary.p50 << ", p95 " << summary.p95 << ", p99 " << summary.p99 << ", max " << summary.max << "\n";
+			}
+			std::string filename = "ppu-stats.csv";
+			if (ppu_stats.write_csv(filename)) {
+				std::cout << "Wrote '" << filename << "'." << std::endl;
+			} else {
+				std::cerr << "Failed to write '" << filename << "'." << std::endl;
+			}
+			return true;
 		}
 	} else if (evt.type == SDL_EVENT_KEY_UP) {
 		if (evt.key.key == SDLK_LEFT) {
@@ -481,24 +277,34 @@ void PlayMode::update(float elapsed) {
 	// if (down.pressed) player_at.y -= PlayerSpeed * elapsed;
 	// if (up.pressed) player_at.y += PlayerSpeed * elapsed;
 
-	if (left.pressed) {
-		player.physicsObject.velocity[0] -= player.RUN_ACCEL;
-		player.physicsObject.velocity[0] = std::min(player.physicsObject.velocity[0], -player.RUN_SPEED);
-	}
-	if (right.pressed) {
-		player.physicsObject.velocity[0] += player.RUN_ACCEL;
-		player.physicsObject.velocity[0] = std::max(player.physicsObject.velocity[0], player.RUN_SPEED);
+	// 'elapsed' is one fixed step, so all rates below are per second and scaled by it
+	player.gameObject.previous_position = player.gameObject.position;
+	std::array<float, 2> &velocity = player.physicsObject.velocity;
+
+	if (left.pressed && !right.pressed) {
+		velocity[0] = std::max(velocity[0] - player.RUN_ACCEL * elapsed, -player.RUN_SPEED);
+	} else if (right.pressed && !left.pressed) {
+		velocity[0] = std::min(velocity[0] + player.RUN_ACCEL * elapsed, player.RUN_SPEED);
+	} else {
+		// slow to a stop
+		float slow = player.RUN_DECEL * elapsed;
+		velocity[0] = (velocity[0] > 0 ? std::max(velocity[0] - slow, 0.0f) : std::min(velocity[0] + slow, 0.0f));
 	}
 	if (up.pressed && !player.airborne) {
-		player.physicsObject.velocity[1] += player.INIT_JUMP_SPEED;
+		velocity[1] = player.INIT_JUMP_SPEED;
+		player.airborne = true;
 	}
 
-	player.physicsObject.velocity[0] += player.physicsObject.gravity[0];
-	player.physicsObject.velocity[1] += player.physicsObject.gravity[1];
+	velocity[0] += player.physicsObject.gravity[0] * elapsed;
+	velocity[1] += player.physicsObject.gravity[1] * elapsed;
+
+	player.gameObject.position[0] += velocity[0] * elapsed;
+	player.gameObject.position[1] += velocity[1] * elapsed;
 
 	if (player.gameObject.position[1] < GROUND_LEVEL + player.gameObject.height_radius[1]) {
 		player.airborne = false;
 		player.gameObject.position[1] = (float) GROUND_LEVEL + player.gameObject.height_radius[1];
+		velocity[1] = 0;
 	}
 
 	//reset button press counters:
@@ -509,6 +315,28 @@ void PlayMode::update(float elapsed) {
 }
 
 void PlayMode::draw(glm::uvec2 const &drawable_size) {
+	draw(drawable_size, 1.0f);
+}
+
+void PlayMode::draw(glm::uvec2 const &drawable_size, float alpha) {
+	update_ppu(alpha);
+
+	//--- actually draw ---
+	ppu.draw(drawable_size);
+}
+
+bool PlayMode::snapshot(PPU466 *out) {
+	//the state as of the latest step (SimulationThread interpolates sprites between snapshots):
+	update_ppu(1.0f);
+	*out = ppu;
+
+	//(ppu_stats is read by handle_event -- which is on this thread -- so the render thread mustn't write it)
+	out->stats = nullptr;
+	snapshotting = true;
+	return true;
+}
+
+void PlayMode::update_ppu(float alpha) {
 	//--- set ppu state based on game state ---
 
 	uint32_t bg_size = PPU466::BackgroundWidth * PPU466::BackgroundHeight;
@@ -519,10 +347,15 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 		ppu.background[t] = 0b0000000100011101; //0x011D;
 	}
 
-	playerSprites[0].x = uint8_t(player.gameObject.position[0] - player.gameObject.width_radius[0]);
-	playerSprites[0].y = uint8_t(player.gameObject.position[1] + 1);
-	playerSprites[1].x = uint8_t(player.gameObject.position[0] - player.gameObject.width_radius[0]);
-	playerSprites[1].y = uint8_t(player.gameObject.position[1] - player.gameObject.height_radius[1]);
+	// draw the player between its last two simulated positions
+	// (x goes through int32_t so a player past the screen edge wraps around instead of overflowing uint8_t)
+	std::array<float, 2> player_at = player.gameObject.drawn_position(alpha);
+	playerSprites[0].x = uint8_t(int32_t(player_at[0] - player.gameObject.width_radius[0]));
+	playerSprites[0].y = uint8_t(player_at[1] + 1);
+	playerSprites[1].x = uint8_t(int32_t(player_at[0] - player.gameObject.width_radius[0]));
+	playerSprites[1].y = uint8_t(player_at[1] - player.gameObject.height_radius[1]);
+	ppu.sprites[0] = playerSprites[0];
+	ppu.sprites[1] = playerSprites[1];
 
 	// set to playerSprites 2 based on active
 	// set to playerSprites 3 to mouse
@@ -553,7 +386,4 @@ void PlayMode::draw(glm::uvec2 const &drawable_size) {
 	// 	ppu.sprites[i].attributes = 6;
 	// 	if (i % 2) ppu.sprites[i].attributes |= 0x80; //'behind' bit
 	// }
-
-	//--- actually draw ---
-	ppu.draw(drawable_size);
 }
@@ -1,4 +1,5 @@
 #include "PPU466.hpp"
+#include "PPUStats.hpp"
 #include "Mode.hpp"
 
 #include <glm/glm.hpp>
@@ -8,9 +9,6 @@
 #include <unordered_set>
 #include <unordered_map>
 
-typedef std::array< std::array< glm::u8vec4 , 8 >, 8 > ColoredTile;
-typedef std::vector< glm::u8vec4 > PaletteBucket; // color as a number to palette bucket index
-
 struct PlayMode : Mode {
 	PlayMode();
 	virtual ~PlayMode();
@@ -19,6 +17,8 @@ struct PlayMode : Mode {
 	virtual bool handle_event(SDL_Event const &, glm::uvec2 const &window_size) override;
 	virtual void update(float elapsed) override;
 	virtual void draw(glm::uvec2 const &drawable_size) override;
+	virtual void draw(glm::uvec2 const &drawable_size, float alpha) override;
+	virtual bool snapshot(PPU466 *ppu) override;
 
 	//----- game state -----
 
@@ -37,4 +37,12 @@ struct PlayMode : Mode {
 	//----- drawing handled by PPU466 -----
 
 	PPU466 ppu;
+
+	//set ppu state based on game state ('alpha' interpolates between the last two update steps):
+	void update_ppu(float alpha);
+
+	//draw timings for ppu (press F2 to print a summary and write them to 'ppu-stats.csv'):
+	PPUStats ppu_stats;
+	//set once snapshot() is called -- snapshots are drawn on another thread, so ppu_stats isn't recorded:
+	bool snapshotting = false;
 };
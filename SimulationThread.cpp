@@ -0,0 +1,143 @@
+#include "SimulationThread.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+
+SimulationThread::SimulationThread(FixedTimestep const &timestep_) : timestep(timestep_) {
+	thread = std::thread([this](){ run(); });
+}
+
+SimulationThread::~SimulationThread() {
+	{
+		std::unique_lock< std::mutex > lock(mutex);
+		quit = true;
+	}
+	wake.notify_all();
+	thread.join();
+}
+
+void SimulationThread::push_event(SDL_Event const &evt, glm::uvec2 const &window_size) {
+	std::unique_lock< std::mutex > lock(mutex);
+	events.emplace_back(QueuedEvent{evt, window_size});
+}
+
+namespace {
+	//moves bigger than this between snapshots are taken to be jumps (teleports, wrapping around the screen, a different object reusing a slot), so aren't interpolated:
+	constexpr int32_t MaxInterpolatedMove = 32;
+
+	int32_t interpolate(int32_t from, int32_t to, float alpha) {
+		if (std::abs(to - from) > MaxInterpolatedMove) return to;
+		return from + int32_t(std::round((to - from) * alpha));
+	}
+}
+
+PPU466 const *SimulationThread::interpolated_snapshot() {
+	{ //switch to the latest snapshot, remembering the one it replaces:
+		//(the first snapshot has nothing before it, so is interpolated from itself)
+		bool had_snapshot = buffer.received;
+		Previous before;
+		if (had_snapshot) {
+			before.sprites = buffer.front().ppu.sprites;
+			before.background_position = buffer.front().ppu.background_position;
+			before.time = buffer.front().time;
+		}
+		if (buffer.update()) {
+			Snapshot const &latest = buffer.front();
+			interpolated = latest.ppu;
+			if (!had_snapshot) {
+				before.sprites = latest.ppu.sprites;
+				before.background_position = latest.ppu.background_position;
+				before.time = latest.time;
+			}
+			previous = before;
+		}
+	}
+	if (!buffer.received) return nullptr;
+
+	Snapshot const &latest = buffer.front();
+
+	//how far real time has moved past the latest snapshot, as a fraction of the time between the last two:
+	// (with one step between snapshots, this is the alpha single-threaded drawing uses; drawing is a step behind the simulation, just the same)
+	float alpha = 1.0f;
+	if (latest.time > previous.time) {
+		alpha = std::chrono::duration< float >(Clock::now() - latest.time) / std::chrono::duration< float >(latest.time - previous.time);
+		alpha = std::max(0.0f, std::min(alpha, 1.0f));
+	}
+
+	for (uint32_t i = 0; i < interpolated.sprites.size(); ++i) {
+		PPU466::Sprite const &from = previous.sprites[i];
+		PPU466::Sprite const &to = latest.ppu.sprites[i];
+		PPU466::Sprite &sprite = interpolated.sprites[i];
+		sprite = to;
+		//only sprites that are on screen in both snapshots, showing the same thing, move smoothly:
+		if (from.y >= PPU466::ScreenHeight || to.y >= PPU466::ScreenHeight) continue;
+		if (from.index != to.index || from.attributes != to.attributes) continue;
+		sprite.x = uint8_t(interpolate(from.x, to.x, alpha));
+		sprite.y = uint8_t(interpolate(from.y, to.y, alpha));
+	}
+	interpolated.background_position = glm::ivec2(
+		interpolate(previous.background_position.x, latest.ppu.background_position.x, alpha),
+		interpolate(previous.background_position.y, latest.ppu.background_position.y, alpha)
+	);
+
+	return &interpolated;
+}
+
+void SimulationThread::run() {
+	auto previous_time = Clock::now();
+
+	std::deque< QueuedEvent > pending;
+	bool published = false;
+
+	while (true) {
+		{ //grab any queued events:
+			std::unique_lock< std::mutex > lock(mutex);
+			if (quit) return;
+			pending.swap(events);
+		}
+
+		for (auto const &e : pending) {
+			if (!Mode::current) break;
+			Mode::current->handle_event(e.evt, e.window_size);
+		}
+		pending.clear();
+
+		//run as many fixed steps as real time calls for:
+		auto current_time = Clock::now();
+		float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
+		previous_time = current_time;
+
+		uint32_t steps = timestep.advance(elapsed);
+		for (uint32_t s = 0; s < steps && Mode::current; ++s) {
+			Mode::current->update(timestep.step);
+		}
+		steps_run.fetch_add(steps, std::memory_order_relaxed);
+		steps_dropped.fetch_add(timestep.last_dropped, std::memory_order_relaxed);
+
+		if (!Mode::current) {
+			done.store(true, std::memory_order_release);
+			return;
+		}
+
+		//hand the new state to the render thread:
+		if (steps > 0 || !published) {
+			if (!Mode::current->snapshot(&buffer.back().ppu)) {
+				no_snapshot.store(true, std::memory_order_release);
+				return;
+			}
+			//(the state is of the last whole step; real time is already 'alpha' of a step past that)
+			buffer.back().time = current_time - std::chrono::duration_cast< Clock::duration >(std::chrono::duration< float >(timestep.step * timestep.alpha()));
+			buffer.publish();
+			published = true;
+			snapshots.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		//sleep until the next step is due (events that arrive meanwhile will be handled then):
+		auto until_step = std::chrono::duration< float >(timestep.step * (1.0f - timestep.alpha()));
+		auto wake_time = current_time + std::chrono::duration_cast< Clock::duration >(until_step);
+		std::unique_lock< std::mutex > lock(mutex);
+		wake.wait_until(lock, wake_time, [this](){ return quit; });
+	}
+}
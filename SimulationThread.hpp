@@ -0,0 +1,93 @@
+#pragma once
+
+/*
+ * SimulationThread -- runs Mode::current's event handling and updates on a thread of its own.
+ *
+ * The simulation thread steps Mode::current at a fixed rate (see FixedTimestep.hpp) and,
+ *  after each batch of steps, asks it for a Mode::snapshot() of the PPU466 state it would draw.
+ * Snapshots go through a TripleBuffer, so the render thread just draws the latest one:
+ *  a slow frame on either side never stalls the other.
+ * Each snapshot is stamped with the real time its step stands for (using the FixedTimestep's alpha),
+ *  so the render thread can move sprites (and the background) between the last two snapshots
+ *  the way single-threaded drawing interpolates between the last two steps.
+ *
+ * While the thread is running, it owns Mode::current: the main thread must not touch it
+ *  (events are passed along with push_event() instead) until the SimulationThread is destroyed.
+ *
+ */
+
+#include "FixedTimestep.hpp"
+#include "Mode.hpp"
+#include "PPU466.hpp"
+#include "TripleBuffer.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+struct SimulationThread {
+	//start simulating Mode::current:
+	explicit SimulationThread(FixedTimestep const &timestep);
+	//stop (and wait for) the simulation thread:
+	~SimulationThread();
+
+	SimulationThread(SimulationThread const &) = delete;
+	SimulationThread &operator=(SimulationThread const &) = delete;
+
+	//queue an event for Mode::current (handled before the next update step):
+	void push_event(SDL_Event const &evt, glm::uvec2 const &window_size);
+
+	//most recent snapshot, with sprites and background position interpolated from the snapshot before it
+	// according to how much real time has passed (nullptr if there hasn't been one yet); valid until the next call:
+	PPU466 const *interpolated_snapshot();
+
+	//true once Mode::current has become null (e.g., the mode wants the game to quit):
+	bool finished() const { return done.load(std::memory_order_acquire); }
+
+	//true if Mode::current returned false from snapshot() -- it will need to be run without a SimulationThread:
+	bool unsupported() const { return no_snapshot.load(std::memory_order_acquire); }
+
+	//telemetry (updated by the simulation thread):
+	std::atomic< uint64_t > steps_run{0};
+	std::atomic< uint64_t > steps_dropped{0};
+	std::atomic< uint64_t > snapshots{0};
+
+	//--------------------------------------------------------------
+	//internals:
+
+	FixedTimestep timestep; //(only touched by the simulation thread)
+
+	typedef std::chrono::high_resolution_clock Clock;
+
+	struct Snapshot {
+		PPU466 ppu;
+		Clock::time_point time; //real time at which the simulation reached this state
+	};
+	TripleBuffer< Snapshot > buffer;
+
+	//render thread's view of the snapshot before the latest one (just the parts that get interpolated):
+	struct Previous {
+		std::array< PPU466::Sprite, std::tuple_size< decltype(PPU466::sprites) >::value > sprites;
+		glm::ivec2 background_position = glm::ivec2(0);
+		Clock::time_point time;
+	} previous;
+	PPU466 interpolated; //latest snapshot, with interpolated sprites and background position
+
+	struct QueuedEvent {
+		SDL_Event evt;
+		glm::uvec2 window_size;
+	};
+	std::mutex mutex; //protects 'events' and 'quit'
+	std::condition_variable wake;
+	std::deque< QueuedEvent > events;
+	bool quit = false;
+
+	std::atomic< bool > done{false};
+	std::atomic< bool > no_snapshot{false};
+
+	std::thread thread;
+	void run();
+};
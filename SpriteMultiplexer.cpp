@@ -0,0 +1,108 @@
+#include "SpriteMultiplexer.hpp"
+
+#include <algorithm>
+#include <cassert>
+
+SpriteMultiplexer::SpriteMultiplexer(uint32_t capacity, uint32_t first_slot_, uint32_t slot_count_) : first_slot(first_slot_), slot_count(slot_count_) {
+	assert(first_slot + slot_count <= std::tuple_size< decltype(PPU466::sprites) >::value && "slots must be within the PPU's sprite list");
+	sprites.resize(capacity);
+	sprite_stats.resize(capacity);
+	sorted.resize(capacity);
+}
+
+void SpriteMultiplexer::clear() {
+	for (auto &s : sprites) {
+		s.visible = false;
+	}
+}
+
+void SpriteMultiplexer::set(uint32_t id, PPU466::Sprite const &sprite, uint8_t priority) {
+	assert(id < sprites.size());
+	sprites[id].sprite = sprite;
+	sprites[id].priority = priority;
+	sprites[id].visible = true;
+}
+
+void SpriteMultiplexer::hide(uint32_t id) {
+	assert(id < sprites.size());
+	sprites[id].visible = false;
+}
+
+void SpriteMultiplexer::reset_stats() {
+	for (auto &s : sprite_stats) {
+		s = SpriteStats();
+	}
+}
+
+void SpriteMultiplexer::assign(PPU466 *ppu) {
+	assert(ppu);
+
+	//counting sort of visible sprites, highest priority first (and by id within a priority):
+	level_begin.fill(0);
+	uint32_t visible = 0;
+	for (auto const &s : sprites) {
+		if (!s.visible) continue;
+		level_begin[s.priority] += 1;
+		visible += 1;
+	}
+	{ //convert counts into the starting index of each level (level 255 comes first):
+		uint32_t total = 0;
+		for (uint32_t p = uint32_t(level_begin.size()); p > 0; --p) {
+			uint32_t count = level_begin[p-1];
+			level_begin[p-1] = total;
+			total += count;
+		}
+	}
+	//(level_begin[p] is used as an insertion point, so it ends up at the *end* of level p)
+	for (uint32_t id = 0; id < sprites.size(); ++id) {
+		if (!sprites[id].visible) continue;
+		sorted[level_begin[sprites[id].priority]++] = id;
+	}
+
+	//hand out slots in sorted order:
+	uint32_t slot = 0;
+	uint32_t i = 0;
+	while (i < visible && slot < slot_count) {
+		//find the extent of this priority level:
+		uint8_t priority = sprites[sorted[i]].priority;
+		uint32_t level_end = level_begin[priority];
+		uint32_t count = level_end - i;
+
+		if (count <= slot_count - slot) {
+			//whole level fits:
+			for (; i < level_end; ++i) {
+				ppu->sprites[first_slot + slot++] = sprites[sorted[i]].sprite;
+				sprite_stats[sorted[i]].shown += 1;
+			}
+		} else {
+			//level doesn't fit, so pick a rotating window of its sprites:
+			uint32_t take = slot_count - slot;
+			uint32_t start = rotation % count;
+			for (uint32_t j = 0; j < count; ++j) {
+				uint32_t id = sorted[i + (start + j) % count];
+				if (j < take) {
+					ppu->sprites[first_slot + slot++] = sprites[id].sprite;
+					sprite_stats[id].shown += 1;
+				} else {
+					sprite_stats[id].dropped += 1;
+				}
+			}
+			//next frame, start just after the last sprite shown:
+			rotation = start + take;
+			i = level_end;
+		}
+	}
+
+	//anything left over doesn't fit at all:
+	for (; i < visible; ++i) {
+		sprite_stats[sorted[i]].dropped += 1;
+	}
+
+	//move unused slots off-screen:
+	for (; slot < slot_count; ++slot) {
+		ppu->sprites[first_slot + slot] = PPU466::Sprite();
+	}
+
+	last_visible = visible;
+	last_dropped = visible - std::min(visible, slot_count);
+}
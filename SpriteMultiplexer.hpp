@@ -0,0 +1,84 @@
+#pragma once
+
+/*
+ * SpriteMultiplexer -- more sprites than PPU466 has slots for, via "flicker".
+ *
+ * Game code sets any number (up to a fixed capacity) of logical sprites each frame, each with a priority.
+ * assign() then copies them into a range of PPU466 hardware sprite slots:
+ *  - higher priorities always win slots over lower priorities;
+ *  - when a priority level doesn't fit, the sprites from that level that get slots
+ *    rotate from frame to frame (so every sprite is shown some of the time);
+ *  - sprites are placed in slots in priority order, so higher priorities also win
+ *    when PPU466::limit_sprites_per_line is set.
+ *
+ * assign() takes O(n) time (for n = capacity) and never allocates.
+ *
+ * Usage:
+ *  SpriteMultiplexer bullets(200, 32, 32); //up to 200 bullets, in hardware slots [32,64)
+ *  //every frame:
+ *  bullets.clear();
+ *  for (auto const &b : bullet_list) bullets.set(b.id, sprite_for(b), b.important ? 1 : 0);
+ *  bullets.assign(&ppu);
+ *
+ */
+
+#include "PPU466.hpp"
+
+#include <array>
+#include <vector>
+
+struct SpriteMultiplexer {
+	//logical sprite ids will be in [0,capacity); hardware slots used are [first_slot, first_slot + slot_count):
+	SpriteMultiplexer(uint32_t capacity, uint32_t first_slot = 0, uint32_t slot_count = uint32_t(std::tuple_size< decltype(PPU466::sprites) >::value));
+
+	//hide all logical sprites (typically called at the start of each frame):
+	void clear();
+
+	//show logical sprite 'id' this frame (larger priority values are more important):
+	void set(uint32_t id, PPU466::Sprite const &sprite, uint8_t priority = 0);
+
+	//hide logical sprite 'id' this frame:
+	void hide(uint32_t id);
+
+	//write visible logical sprites into ppu's hardware slots (unused slots are moved off-screen) and update stats:
+	void assign(PPU466 *ppu);
+
+	//--------------------------------------------------------------
+	//stats:
+
+	//per logical sprite, counted over all calls to assign() in which the sprite was visible:
+	struct SpriteStats {
+		uint32_t shown = 0; //frames the sprite got a hardware slot
+		uint32_t dropped = 0; //frames the sprite was visible but didn't get a slot
+	};
+	SpriteStats const &stats(uint32_t id) const { return sprite_stats[id]; }
+	void reset_stats();
+
+	//results of the most recent assign():
+	uint32_t last_visible = 0; //logical sprites that were visible
+	uint32_t last_dropped = 0; //...and of those, how many didn't get a slot
+
+	uint32_t capacity() const { return uint32_t(sprites.size()); }
+
+	//--------------------------------------------------------------
+	//internals:
+
+	uint32_t first_slot;
+	uint32_t slot_count;
+
+	//logical sprites:
+	struct LogicalSprite {
+		PPU466::Sprite sprite;
+		uint8_t priority = 0;
+		bool visible = false;
+	};
+	std::vector< LogicalSprite > sprites;
+	std::vector< SpriteStats > sprite_stats;
+
+	//scratch space for sorting visible sprites by priority (allocated once):
+	std::vector< uint32_t > sorted;
+	std::array< uint32_t, 256 > level_begin;
+
+	//rotates which sprites of a partially-fitting priority level get slots:
+	uint32_t rotation = 0;
+};
@@ -0,0 +1,61 @@
+#pragma once
+
+/*
+ * TripleBuffer -- hands the latest value from one producer thread to one consumer thread without locking.
+ *
+ * The producer fills back() and calls publish(); the consumer calls update() and reads front().
+ * Neither side ever waits on the other: the producer always has a free slot to write into,
+ *  and the consumer always sees the most recently published value (values published in between
+ *  are skipped, which is what you want for, e.g., frames of game state).
+ *
+ * The three slots are swapped by index, so a T is never copied by the buffer itself.
+ *
+ */
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+template< typename T >
+struct TripleBuffer {
+	//--------------------------------------------------------------
+	//producer:
+
+	//slot to write the next value into:
+	T &back() { return slots[back_index]; }
+
+	//make back() available to the consumer (and start writing into a different slot):
+	void publish() {
+		back_index = state.exchange(uint8_t(back_index | Fresh), std::memory_order_acq_rel) & IndexMask;
+	}
+
+	//--------------------------------------------------------------
+	//consumer:
+
+	//switch front() to the most recently published value; returns false if nothing new has been published:
+	bool update() {
+		if (!(state.load(std::memory_order_relaxed) & Fresh)) return false;
+		front_index = state.exchange(front_index, std::memory_order_acq_rel) & IndexMask;
+		received = true;
+		return true;
+	}
+
+	//most recent value seen by update() (if 'received' is false, nothing has been published yet):
+	T const &front() const { return slots[front_index]; }
+	bool received = false;
+
+	//--------------------------------------------------------------
+	//internals:
+
+	std::array< T, 3 > slots;
+
+	//the slot not owned by either side, plus a flag saying if it holds a value the consumer hasn't seen:
+	enum : uint8_t {
+		IndexMask = 0x3,
+		Fresh = 0x4,
+	};
+	std::atomic< uint8_t > state{1};
+
+	uint8_t back_index = 0; //(only touched by the producer)
+	uint8_t front_index = 2; //(only touched by the consumer)
+};
@@ -0,0 +1,367 @@
+//Headless benchmark for PlayMode + PPU466:
+// runs PlayMode::update and PlayMode::draw (into an offscreen framebuffer) for a number of frames
+// and reports how long they took, how much memory they allocated, and how much data went to the GPU.
+// With --software, frames are rendered on the CPU with PPU466::render instead of drawn with OpenGL,
+// then the last frame is rendered again with PPURenderPool at 1, 2, 4, ... threads (up to --max-threads).
+//Build with:
+//$ node Maekfile.js dist/bench
+//Run with:
+//$ dist/bench [--frames <n>] [--draw-method vertices|instanced|fullscreen] [--software [--max-threads <n>]]
+
+#include "PlayMode.hpp"
+#include "PPUStats.hpp"
+#include "PPURenderPool.hpp"
+#include "Load.hpp"
+#include "GL.hpp"
+
+#include <SDL3/SDL.h>
+#include <SDL3/SDL_main.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <thread>
+#include <vector>
+
+//------------ allocation counting ------------
+//(counts everything that goes through global operator new -- not, e.g., allocations inside the GL driver)
+
+//(gcc sees the malloc/free inside these replacements as mismatched with new/delete, which is fine here)
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+#endif
+
+namespace {
+	std::atomic< uint64_t > allocations{0};
+	std::atomic< uint64_t > allocated_bytes{0};
+}
+
+void *operator new(std::size_t size) {
+	allocations.fetch_add(1, std::memory_order_relaxed);
+	allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+	if (void *ptr = std::malloc(size == 0 ? 1 : size)) return ptr;
+	throw std::bad_alloc();
+}
+void operator delete(void *ptr) noexcept {
+	std::free(ptr);
+}
+void operator delete(void *ptr, std::size_t) noexcept {
+	std::free(ptr);
+}
+
+//------------ statistics ------------
+
+namespace {
+	struct Summary {
+		double mean = 0.0;
+		double p50 = 0.0;
+		double p99 = 0.0;
+		double max = 0.0;
+	};
+	Summary summarize(std::vector< double > values) {
+		Summary ret;
+		if (values.empty()) return ret;
+		double sum = 0.0;
+		for (double v : values) sum += v;
+		ret.mean = sum / values.size();
+		//nearest-rank percentiles:
+		std::sort(values.begin(), values.end());
+		auto percentile = [&values](double p) {
+			size_t rank = size_t(std::ceil(p / 100.0 * values.size()));
+			return values[std::min(values.size(), std::max< size_t >(rank, 1)) - 1];
+		};
+		ret.p50 = percentile(50.0);
+		ret.p99 = percentile(99.0);
+		ret.max = values.back();
+		return ret;
+	}
+	void print(std::string const &name, Summary const &s, char const *units) {
+		std::cout << "  " << std::left << std::setw(18) << name << std::right
+		          << " mean " << std::setw(10) << s.mean
+		          << "  p50 " << std::setw(10) << s.p50
+		          << "  p99 " << std::setw(10) << s.p99
+		          << "  max " << std::setw(10) << s.max
+		          << " " << units << "\n";
+	}
+}
+
+int main(int argc, char **argv) {
+#ifdef _WIN32
+	//when compiled on windows, unhandled exceptions don't have their message printed, which can make debugging simple issues difficult.
+	try {
+#endif
+
+	//------------  command line ------------
+
+	uint32_t frames = 2000; //frames to time
+	uint32_t warmup = 30; //frames to run before timing (first uploads, driver warm-up)
+	PPU466::DrawMethod draw_method = PPU466::DrawMethod::Vertices;
+	bool software = false; //render with PPU466::render instead of drawing
+	uint32_t max_threads = std::max(1U, std::thread::hardware_concurrency()); //largest PPURenderPool to try with --software
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--frames" && argi + 1 < argc) {
+			frames = uint32_t(std::strtoul(argv[++argi], nullptr, 10));
+		} else if (arg == "--draw-method" && argi + 1 < argc) {
+			std::string method = argv[++argi];
+			if (method == "vertices") draw_method = PPU466::DrawMethod::Vertices;
+			else if (method == "instanced") draw_method = PPU466::DrawMethod::Instanced;
+			else if (method == "fullscreen") draw_method = PPU466::DrawMethod::FullscreenBackground;
+			else {
+				std::cerr << "Unknown draw method '" << method << "'." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--software") {
+			software = true;
+		} else if (arg == "--max-threads" && argi + 1 < argc) {
+			max_threads = std::max(1UL, std::strtoul(argv[++argi], nullptr, 10));
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--frames <n>] [--draw-method vertices|instanced|fullscreen] [--software [--max-threads <n>]]" << std::endl;
+			return 1;
+		}
+	}
+	if (frames == 0) {
+		std::cerr << "Expected at least one frame." << std::endl;
+		return 1;
+	}
+
+	//------------  initialization ------------
+
+	//Initialize SDL library and make an OpenGL context:
+	// tries the 'offscreen' video driver first, which needs no display server;
+	// if that isn't available (or can't make an OpenGL context), falls back to the default driver with a hidden window.
+	SDL_GLContext context = 0;
+	for (char const *driver : { "offscreen", (char const *)nullptr }) {
+		if (driver) SDL_SetHint(SDL_HINT_VIDEO_DRIVER, driver);
+		else SDL_ResetHint(SDL_HINT_VIDEO_DRIVER);
+
+		if (!SDL_Init(SDL_INIT_VIDEO)) {
+			std::cerr << "Note: couldn't initialize the " << (driver ? driver : "default") << " video driver: " << SDL_GetError() << std::endl;
+			continue;
+		}
+
+		//Ask for an OpenGL context version 3.3, core profile:
+		SDL_GL_ResetAttributes();
+		SDL_GL_SetAttribute(SDL_GL_RED_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_GREEN_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_BLUE_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_ALPHA_SIZE, 8);
+		SDL_GL_SetAttribute(SDL_GL_DOUBLEBUFFER, 1);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, 3);
+		SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, 3);
+
+		//a window is needed to get a context, but it is never shown (everything is drawn offscreen):
+		Mode::window = SDL_CreateWindow(
+			"gp25 game1 bench",
+			PPU466::ScreenWidth, PPU466::ScreenHeight,
+			SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN
+		);
+		if (Mode::window) {
+			context = SDL_GL_CreateContext(Mode::window);
+			if (context) break;
+		}
+
+		std::cerr << "Note: couldn't create an OpenGL context with the " << (driver ? driver : "default") << " video driver: " << SDL_GetError() << std::endl;
+		if (Mode::window) {
+			SDL_DestroyWindow(Mode::window);
+			Mode::window = NULL;
+		}
+		SDL_Quit();
+	}
+	if (!context) {
+		std::cerr << "Error creating OpenGL context." << std::endl;
+		return 1;
+	}
+
+	//On windows, load OpenGL entrypoints: (does nothing on other platforms)
+	init_GL();
+
+	//offscreen framebuffer at 2x scale (like the game's default window):
+	glm::uvec2 drawable_size = glm::uvec2(2 * PPU466::ScreenWidth, 2 * PPU466::ScreenHeight);
+	GLuint color_rb = 0, fb = 0;
+	glGenRenderbuffers(1, &color_rb);
+	glBindRenderbuffer(GL_RENDERBUFFER, color_rb);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, drawable_size.x, drawable_size.y);
+	glBindRenderbuffer(GL_RENDERBUFFER, 0);
+	glGenFramebuffers(1, &fb);
+	glBindFramebuffer(GL_FRAMEBUFFER, fb);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color_rb);
+	if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+		std::cerr << "Offscreen framebuffer is incomplete." << std::endl;
+		return 1;
+	}
+	glViewport(0, 0, drawable_size.x, drawable_size.y);
+
+	//------------ load assets + create mode --------------
+
+	call_load_functions();
+
+	{
+		std::shared_ptr< PlayMode > mode = std::make_shared< PlayMode >();
+		mode->ppu.draw_method = draw_method;
+		PPUStats stats(frames + 1); //(+1 for the final draw, below)
+		mode->ppu.stats = &stats;
+
+		//where --software renders to:
+		std::vector< glm::u8vec4 > pixels(PPU466::ScreenWidth * PPU466::ScreenHeight);
+
+		//------------ run --------------
+
+		//the game's defaults: 120Hz updates, drawn at 60Hz:
+		constexpr float Step = 1.0f / 120.0f;
+		constexpr uint32_t StepsPerFrame = 2;
+
+		//scripted input, so the player actually runs and jumps:
+		auto press = [&mode, &drawable_size](SDL_Keycode key, bool down) {
+			SDL_Event evt{};
+			evt.type = (down ? SDL_EVENT_KEY_DOWN : SDL_EVENT_KEY_UP);
+			evt.key.key = key;
+			mode->handle_event(evt, drawable_size);
+		};
+
+		std::vector< double > update_ms, draw_ms, frame_ms, allocs, alloc_bytes;
+		update_ms.reserve(frames);
+		draw_ms.reserve(frames);
+		frame_ms.reserve(frames);
+		allocs.reserve(frames);
+		alloc_bytes.reserve(frames);
+
+		for (uint32_t f = 0; f < warmup + frames; ++f) {
+			if (f % 120 == 0) { press(SDLK_LEFT, false); press(SDLK_RIGHT, true); }
+			if (f % 120 == 60) { press(SDLK_RIGHT, false); press(SDLK_LEFT, true); }
+			press(SDLK_UP, f % 90 == 0);
+
+			uint64_t allocations_before = allocations.load(std::memory_order_relaxed);
+			uint64_t bytes_before = allocated_bytes.load(std::memory_order_relaxed);
+			auto before = std::chrono::high_resolution_clock::now();
+
+			for (uint32_t s = 0; s < StepsPerFrame; ++s) {
+				mode->update(Step);
+			}
+			auto after_update = std::chrono::high_resolution_clock::now();
+
+			if (software) {
+				mode->update_ppu(0.5f);
+				mode->ppu.render(pixels.data());
+			} else {
+				mode->draw(drawable_size, 0.5f);
+			}
+			auto after_draw = std::chrono::high_resolution_clock::now();
+
+			uint64_t frame_allocations = allocations.load(std::memory_order_relaxed) - allocations_before;
+			uint64_t frame_bytes = allocated_bytes.load(std::memory_order_relaxed) - bytes_before;
+
+			//wait for the GPU so frames don't pile up (not counted in frame cost; see GPU time below):
+			if (!software) glFinish();
+
+			if (f < warmup) {
+				if (f + 1 == warmup) stats.clear();
+				continue;
+			}
+			update_ms.emplace_back(std::chrono::duration< double, std::milli >(after_update - before).count());
+			draw_ms.emplace_back(std::chrono::duration< double, std::milli >(after_draw - after_update).count());
+			frame_ms.emplace_back(std::chrono::duration< double, std::milli >(after_draw - before).count());
+			allocs.emplace_back(double(frame_allocations));
+			alloc_bytes.emplace_back(double(frame_bytes));
+		}
+
+		//one more (untimed, unreported) draw collects the last frame's GPU timer result:
+		if (!software) {
+			mode->draw(drawable_size, 0.5f);
+			glFinish();
+		}
+		mode->ppu.stats = nullptr;
+
+		//------------ report --------------
+
+		std::vector< double > gpu_ms, vertices, upload_bytes;
+		for (uint32_t i = 0; i + 1 < stats.size(); ++i) {
+			PPUStats::Frame const &frame = stats.frame(i);
+			if (frame.gpu_ms >= 0.0f) gpu_ms.emplace_back(frame.gpu_ms);
+			vertices.emplace_back(frame.vertices);
+			upload_bytes.emplace_back(frame.upload_bytes);
+		}
+
+		char const *method_names[] = {"vertices", "instanced", "fullscreen"};
+		std::cout << std::fixed << std::setprecision(4);
+		if (software) {
+			std::cout << frames << " frames (" << StepsPerFrame << " updates each), rendered in software:\n";
+		} else {
+			std::cout << frames << " frames (" << StepsPerFrame << " updates each), draw method " << method_names[int(draw_method)] << ":\n";
+		}
+		print("update (cpu)", summarize(update_ms), "ms");
+		print(software ? "render (cpu)" : "draw (cpu)", summarize(draw_ms), "ms");
+		print("frame (cpu)", summarize(frame_ms), "ms");
+		if (!software) print("draw (gpu)", summarize(gpu_ms), "ms");
+		std::cout << std::setprecision(1);
+		print("allocations", summarize(allocs), "per frame");
+		print("allocated", summarize(alloc_bytes), "bytes per frame");
+		if (software) {
+			std::cout << "  " << std::left << std::setw(18) << "render rate" << std::right
+			          << " " << std::setw(10) << 1000.0 / summarize(draw_ms).mean << " frames/s\n";
+
+			//thread-count sweep (the last frame's state, rendered 'frames' times at each thread count):
+			std::cout << "PPURenderPool, last frame rendered " << frames << " times:\n";
+			std::vector< uint32_t > thread_counts;
+			for (uint32_t threads = 1; threads < max_threads; threads *= 2) thread_counts.emplace_back(threads);
+			thread_counts.emplace_back(max_threads);
+			std::cout << std::setprecision(4);
+			for (uint32_t threads : thread_counts) {
+				//one thread is just PPU466::render; otherwise the calling thread renders bands alongside the pool's workers:
+				std::unique_ptr< PPURenderPool > pool;
+				if (threads > 1) pool = std::make_unique< PPURenderPool >(threads - 1);
+
+				std::vector< double > render_ms;
+				render_ms.reserve(frames);
+				for (uint32_t f = 0; f < warmup + frames; ++f) {
+					auto before = std::chrono::high_resolution_clock::now();
+					if (pool) pool->render(mode->ppu, pixels.data());
+					else mode->ppu.render(pixels.data());
+					auto after = std::chrono::high_resolution_clock::now();
+					if (f >= warmup) render_ms.emplace_back(std::chrono::duration< double, std::milli >(after - before).count());
+				}
+
+				Summary summary = summarize(render_ms);
+				std::string units = "ms (" + std::to_string(uint32_t(1000.0 / summary.mean)) + " frames/s)";
+				print(std::to_string(threads) + (threads == 1 ? " thread" : " threads"), summary, units.c_str());
+			}
+		} else {
+			print("vertices", summarize(vertices), "per frame");
+			print("uploaded", summarize(upload_bytes), "bytes per frame");
+		}
+		std::cout.flush();
+	}
+
+	//------------  teardown ------------
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteFramebuffers(1, &fb);
+	glDeleteRenderbuffers(1, &color_rb);
+
+	SDL_GL_DestroyContext(context);
+	context = 0;
+
+	SDL_DestroyWindow(Mode::window);
+	Mode::window = NULL;
+
+	return 0;
+
+#ifdef _WIN32
+	} catch (std::exception const &e) {
+		std::cerr << "Unhandled exception:\n" << e.what() << std::endl;
+		return 1;
+	} catch (...) {
+		std::cerr << "Unhandled exception (unknown type)." << std::endl;
+		throw;
+	}
+#endif
+}
@@ -0,0 +1,285 @@
+//Compiles the game's spritesheet and palettes into PPU466 tiles and palettes,
+// so the game can load them directly (see PlayMode.cpp) instead of decoding and sorting pngs at startup.
+//Built and run by Maekfile.js; to run by hand:
+//$ dist/compile-tiles assets/spritesheet.png assets/palettes.png dist/spritesheet.tiles
+//Output is two chunks (see read_write_chunk.hpp):
+// "tile" -- tiles for the start of PPU466::tile_table
+// "pale" -- palettes for the start of PPU466::palette_table
+
+#include "PPU466.hpp"
+#include "load_save_png.hpp"
+#include "read_write_chunk.hpp"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+typedef std::array< std::array< glm::u8vec4 , 8 >, 8 > ColoredTile;
+typedef std::vector< glm::u8vec4 > PaletteBucket; // color as a number to palette bucket index
+
+int color_compare(glm::uvec4 color_a, glm::uvec4 color_b) {
+	for (int i = 0; i < 4; i++) {
+		if (color_a[i] < color_b[i])
+			return -1;
+		else if (color_a[i] > color_b[i])
+			return 1;
+	}
+	return 0;
+}
+bool palette_match(std::vector<glm::u8vec4> colors, std::vector<glm::u8vec4> cmpPalette) {
+	if (colors.size() > cmpPalette.size()) {
+		// check if colors is a strict superset
+		for (uint8_t p = 0; p < cmpPalette.size(); p++) {
+			bool color_found = false;
+			for (uint8_t c = 0; c < colors.size(); c++) {
+				if (colors[c] == cmpPalette[p])
+					color_found = true;
+			}
+			if (!color_found)
+				return false;
+		}
+		return true;
+	}
+	else {
+		// check if colors is a strict subset of cmpPalette
+		// or if colors and cmpPalette match
+		for (uint8_t c = 0; c < colors.size(); c++) {
+			bool color_found = false;
+			for (uint8_t p = 0; p < cmpPalette.size(); p++) {
+				if (colors[c] == cmpPalette[p])
+					color_found = true;
+			}
+			if (!color_found)
+				return false;
+		}
+		return true;
+	}
+}
+
+/*****************************
+ * Asset Pipeline Functions
+ *****************************/
+void process_tiles(std::string const &filename, std::vector< PPU466::Tile > *tiles_) {
+	assert(tiles_);
+	auto &tiles = *tiles_;
+
+	/***********************************************************************************
+	 * TILES
+	 * Based on code provided by Jim McCann.
+	 * 
+	 * 1) Scan and get spritesheet data into an array
+	 * 2) Do index math to get "png tiles" (8x8 blocks)
+	 * 3) Calculate Palette Indices from colors:
+	 *    a) put tiles into buckets based on colors found
+	 *    b) if a tile has no conflicting colors with a bucket,
+	 *       it goes in that bucket (bucket gets updated). Create buckets as needed
+	 *    c) Go through each bucket and assign each color a number 0-3
+	 * 		 (transparent (0xeeeeee) is 0, 1-3 are sorted smallest hex value to largest)
+	 *    d) Create tiles based on number
+	 *    e) (if time) create flipped versions of tiles?
+	************************************************/
+
+	//1) Scan for data
+	const uint64_t spritesheet_dimensions = 64*48;
+	const uint64_t tile_count = 46;
+	glm::uvec2 spritesheet_size(0, 0);
+	std::vector< glm::u8vec4 > raw_tile_pixels;
+
+	// ColoredTile holds color info rather than palette index info (we'll use it to construct the palette info for the tile)
+	std::array< ColoredTile, tile_count > colored_tiles;
+	load_png(filename, &spritesheet_size, &raw_tile_pixels, OriginLocation::UpperLeftOrigin);
+	if (spritesheet_size != glm::uvec2(64, 48)) {
+		throw std::runtime_error("Expected '" + filename + "' to be 64x48, but it is " + std::to_string(spritesheet_size.x) + "x" + std::to_string(spritesheet_size.y) + ".");
+	}
+	tiles.resize(tile_count);
+
+	// 2) Index math
+	for (uint64_t r = 0; r < spritesheet_dimensions / 8; r++) {
+		// 8-pixel row by 8-pixel row, assign to the right tile
+		std::array< glm::u8vec4, 8 > pixel_row;
+		
+		// go across the pixels and get the row
+		for (int p = 0; p < 8; p++) {
+			pixel_row[p] = raw_tile_pixels[(8 * r) + p];
+		}
+
+		// then, assign the pixel row to the right tile:
+		// get the row and the column it belongs in on the tbale
+		// then calculate the index in the table tile
+		uint64_t table_row = r / 64;
+		uint64_t table_col = r % 8;
+		uint64_t table_idx = (table_row * 8) + table_col;
+
+		if (table_idx < tile_count) {
+			uint64_t row_num = (r / 8) % 8; // row in the tile
+			colored_tiles[table_idx][row_num] = pixel_row;
+		}
+	}
+
+	// 3) Palette indices
+	// mapping of rgba -> number is a bucket
+	std::array<PaletteBucket, tile_count> palette_buckets;
+	std::unordered_map< uint64_t, uint64_t > tile_palette_map = {}; // used to assign palette indices (color index to palette index)
+	uint64_t buckets_made = 0;
+	for (uint64_t t = 0; t < tile_count; t++) {
+		ColoredTile tile = colored_tiles[t];
+
+		// a) get the colors of the tile
+		std::unordered_set<uint32_t> colors; 
+		for (auto row : tile) {
+			for (uint8_t p = 0; p < 8; p++)
+				colors.emplace((row[p].x << 24) + (row[p].y << 16) + (row[p].z << 8) + row[p].w);
+		}
+		std::vector<glm::u8vec4> color_keys = {};
+		for (uint32_t color : colors) {
+			color_keys.emplace_back(glm::u8vec4((color >> 24) & 0xff,
+									 			(color >> 16) & 0xff,
+									 			(color >> 8) & 0xff,
+									  			 color & 0xff));
+		}
+
+		// b) determine which PaletteBucket it goes in, and add to the tile_palette_map
+		//	  (update buckets as necessary)
+		// compare `colors` to each palette
+		bool bucket_found = false;
+		for (uint64_t p = 0; p < palette_buckets.size(); p++) {
+			PaletteBucket bucket = palette_buckets[p];
+
+			if (bucket.size() > 0) {
+				std::vector<glm::u8vec4> cmpPalette = {};
+				for (auto color_vec : bucket) {
+					cmpPalette.emplace_back(color_vec);
+				}
+
+				if (palette_match(color_keys, cmpPalette)) // first palette to match, map
+				{
+					bucket_found = true;
+					// the larger palette is what the tiles are mapped to
+					if (cmpPalette.size() < colors.size())
+					{
+						// update the bucket with the colors in `colors`
+						palette_buckets[p] = color_keys;
+					}
+					tile_palette_map[t] = p;
+					break;
+				}
+			}
+		}
+
+		if (!bucket_found) {
+			palette_buckets[buckets_made] = color_keys;
+			tile_palette_map[t] = buckets_made;
+			buckets_made++;
+		}
+	}
+
+	// c) sort each bucket to match the palette order ("eeeeee" -- transparency -- first, then ascending)
+	//    (so palette indices don't depend on the order colors came out of the unordered_set above)
+	auto is_transparent = [](glm::u8vec4 const &color) {
+		return color.x == 0xee && color.y == 0xee && color.z == 0xee;
+	};
+	for (uint64_t b = 0; b < buckets_made; b++) {
+		PaletteBucket &bucket = palette_buckets[b];
+		std::sort(bucket.begin(), bucket.end(), [&](glm::u8vec4 const &color_a, glm::u8vec4 const &color_b) {
+			if (is_transparent(color_a) != is_transparent(color_b)) return is_transparent(color_a);
+			return color_compare(color_a, color_b) < 0;
+		});
+	}
+
+	for (uint64_t t = 0; t < tile_count; t++) {
+		// d) construct tile
+		ColoredTile tile = colored_tiles[t];
+		uint64_t palette_index = tile_palette_map[t];
+		PaletteBucket palette_bucket = palette_buckets[palette_index]; // color->int
+
+		for (uint64_t y = 0; y < 8; y++) {
+			std::array< glm::u8vec4, 8 > tile_row = tile[y];
+			uint8_t row_bit_0 = 0;
+			uint8_t row_bit_1 = 0;
+			for (uint64_t x = 0; x < 8; x++) {
+				glm::u8vec4 color = tile_row[x];
+				uint8_t palette_idx = 0;
+				for (uint8_t i = 0; i < palette_bucket.size(); i++)
+					if (color_compare(color, palette_bucket[i]) == 0)
+						palette_idx = i;
+
+				// (x,y) -> color -> palette_idx (from PaletteBucket)
+				row_bit_0 += (palette_idx % 2) << (7 - x);
+				row_bit_1 += (palette_idx / 2) << (7 - x);
+			}
+			tiles[t].bit0[y] = row_bit_0;
+			tiles[t].bit1[y] = row_bit_1;
+		}
+	}
+
+}
+void process_palettes(std::string const &filename, std::vector< PPU466::Palette > *palettes_) {
+	assert(palettes_);
+	auto &palettes = *palettes_;
+
+	/*********************************************************************************
+	 * PALETTES
+	 * Palettes are also pngs, use load_png to convert to color format.
+	 * Assumes palette is already sorted
+	 * (with the exception of "eeeeee" leading if present,
+	 *  as that marks transparency)
+	 *********************************************************************************/
+	glm::uvec2 palette_sheet_size(0, 0);
+	std::vector< glm::u8vec4 > palette_data;
+
+	load_png(filename, &palette_sheet_size, &palette_data, OriginLocation::UpperLeftOrigin);
+	if (palette_sheet_size.x != 4 || palette_sheet_size.y == 0 || palette_sheet_size.y > 8) {
+		throw std::runtime_error("Expected '" + filename + "' to be 4 pixels wide and 1-8 tall, but it is " + std::to_string(palette_sheet_size.x) + "x" + std::to_string(palette_sheet_size.y) + ".");
+	}
+	palettes.resize(palette_sheet_size.y);
+	for (uint64_t i = 0; i < palette_data.size(); i++) {
+		uint64_t pal_tbl_idx = i / 4;
+		uint64_t pal_idx = i % 4;
+
+		if (pal_idx == 0 && palette_data[i][0] == 0xee && palette_data[i][1] == 0xee && palette_data[i][2] == 0xee)
+			palettes[pal_tbl_idx][0] = {0x00, 0x00, 0x00, 0x00};
+		else
+			palettes[pal_tbl_idx][pal_idx] = palette_data[i];
+	}
+
+}
+
+int main(int argc, char **argv) {
+	if (argc != 4) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <spritesheet.png> <palettes.png> <out.tiles>" << std::endl;
+		return 1;
+	}
+	std::string spritesheet_png = argv[1];
+	std::string palettes_png = argv[2];
+	std::string out_tiles = argv[3];
+
+	try {
+		std::vector< PPU466::Tile > tiles;
+		std::vector< PPU466::Palette > palettes;
+		process_tiles(spritesheet_png, &tiles);
+		process_palettes(palettes_png, &palettes);
+
+		std::ofstream out(out_tiles, std::ios::binary);
+		write_chunk("tile", tiles, &out);
+		write_chunk("pale", palettes, &out);
+		if (!out) {
+			throw std::runtime_error("Failed to write '" + out_tiles + "'.");
+		}
+
+		std::cout << "Wrote " << tiles.size() << " tiles and " << palettes.size() << " palettes to '" << out_tiles << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,76 @@
+//Micro-benchmark (and sanity check) for the tile decoders in decode_tile.hpp.
+//Build with:
+//$ node Maekfile.js dist/decode-tile-bench
+
+#include "decode_tile.hpp"
+
+#include <array>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+int main(int argc, char **argv) {
+	//a full tile table of random tiles:
+	std::array< PPU466::Tile, 16 * 16 > tiles;
+	std::mt19937 mt(0x466);
+	for (auto &tile : tiles) {
+		for (uint32_t y = 0; y < 8; ++y) {
+			tile.bit0[y] = uint8_t(mt());
+			tile.bit1[y] = uint8_t(mt());
+		}
+	}
+
+	//same layout PPU466 uses for its tile texture:
+	static std::array< uint8_t, 128 * 128 > reference, decoded;
+
+	auto decode_table = [&tiles](auto const &decode, uint8_t *data) {
+		for (uint32_t i = 0; i < tiles.size(); ++i) {
+			decode(tiles[i], data + (i % 16) * 8 + 128 * ((i / 16) * 8), 128);
+		}
+	};
+
+	//check that every decoder agrees with the reference before timing anything:
+	decode_table(decode_tile_scalar, reference.data());
+
+	decode_table(decode_tile, decoded.data());
+	if (decoded != reference) {
+		std::cerr << "ERROR: decode_tile doesn't match decode_tile_scalar." << std::endl;
+		return 1;
+	}
+
+	for (uint32_t i = 0; i < tiles.size(); ++i) {
+		for (uint32_t y = 0; y < 8; ++y) {
+			uint8_t row[8];
+			decode_tile_row(tiles[i].bit0[y], tiles[i].bit1[y], row);
+			if (std::memcmp(row, &reference[(i % 16) * 8 + 128 * ((i / 16) * 8 + y)], 8) != 0) {
+				std::cerr << "ERROR: decode_tile_row doesn't match decode_tile_row_scalar." << std::endl;
+				return 1;
+			}
+		}
+	}
+
+	//time decoding of the whole table (what PPU466 would do if every tile changed):
+	constexpr uint32_t Iterations = 20000;
+	auto time = [&](char const *name, auto const &decode) {
+		auto before = std::chrono::high_resolution_clock::now();
+		for (uint32_t iter = 0; iter < Iterations; ++iter) {
+			decode_table(decode, decoded.data());
+			//keep the compiler from discarding the work:
+			tiles[iter % tiles.size()].bit0[0] ^= decoded[iter % decoded.size()];
+		}
+		auto after = std::chrono::high_resolution_clock::now();
+		double ns = std::chrono::duration< double, std::nano >(after - before).count();
+		std::cout << name << ": " << ns / Iterations / 1000.0 << " us per table, " << ns / Iterations / tiles.size() << " ns per tile" << std::endl;
+	};
+
+	time("decode_tile_scalar", decode_tile_scalar);
+	time("decode_tile", decode_tile);
+	time("decode_tile (by rows)", [](PPU466::Tile const &tile, uint8_t *data, uint32_t stride) {
+		for (uint32_t y = 0; y < 8; ++y) {
+			decode_tile_row(tile.bit0[y], tile.bit1[y], data + stride * y);
+		}
+	});
+
+	return 0;
+}
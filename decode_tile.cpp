@@ -0,0 +1,127 @@
+#include "decode_tile.hpp"
+
+#include <bit>
+#include <cstring>
+
+#if defined(__AVX2__)
+#define DECODE_TILE_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DECODE_TILE_SSE2
+#include <emmintrin.h>
+#endif
+
+//spread the bits of 'bits' into the low bit of each byte of a 64-bit value (bit x -> byte x):
+static inline uint64_t spread_bits(uint8_t bits) {
+	//copy the byte into every byte, keep bit x in byte x:
+	uint64_t t = (bits * 0x0101010101010101ULL) & 0x8040201008040201ULL;
+	//each byte is now either zero or a single bit, so adding 0x7f sets the byte's high bit iff the byte was non-zero (and never carries):
+	return ((t + 0x7f7f7f7f7f7f7f7fULL) >> 7) & 0x0101010101010101ULL;
+}
+
+void decode_tile_row(uint8_t bit0, uint8_t bit1, uint8_t *indices) {
+	uint64_t row = spread_bits(bit0) | (spread_bits(bit1) << 1);
+	if constexpr (std::endian::native == std::endian::little) {
+		std::memcpy(indices, &row, 8);
+	} else {
+		for (uint32_t x = 0; x < 8; ++x) {
+			indices[x] = uint8_t(row >> (8 * x));
+		}
+	}
+}
+
+void decode_tile(PPU466::Tile const &tile, uint8_t *indices, uint32_t stride) {
+#if defined(DECODE_TILE_AVX2)
+	//broadcast the eight row bytes of each plane to every 64-bit lane:
+	uint64_t b0, b1;
+	std::memcpy(&b0, tile.bit0.data(), 8);
+	std::memcpy(&b1, tile.bit1.data(), 8);
+	const __m256i plane0 = _mm256_set1_epi64x(int64_t(b0));
+	const __m256i plane1 = _mm256_set1_epi64x(int64_t(b1));
+
+	//pixel x of each row tests bit x:
+	const __m256i bit = _mm256_set1_epi64x(int64_t(0x8040201008040201ULL));
+	const __m256i one = _mm256_set1_epi8(1);
+	const __m256i two = _mm256_set1_epi8(2);
+
+	for (uint32_t half = 0; half < 2; ++half) {
+		//copy row bytes 4*half+0..3 to eight consecutive bytes each: (shuffle works within 128-bit lanes)
+		const char r = char(4 * half);
+		const __m256i select = _mm256_setr_epi8(
+			r+0,r+0,r+0,r+0,r+0,r+0,r+0,r+0, r+1,r+1,r+1,r+1,r+1,r+1,r+1,r+1,
+			r+2,r+2,r+2,r+2,r+2,r+2,r+2,r+2, r+3,r+3,r+3,r+3,r+3,r+3,r+3,r+3
+		);
+		__m256i rows0 = _mm256_shuffle_epi8(plane0, select);
+		__m256i rows1 = _mm256_shuffle_epi8(plane1, select);
+		__m256i set0 = _mm256_cmpeq_epi8(_mm256_and_si256(rows0, bit), bit);
+		__m256i set1 = _mm256_cmpeq_epi8(_mm256_and_si256(rows1, bit), bit);
+		__m256i idx = _mm256_or_si256(_mm256_and_si256(set0, one), _mm256_and_si256(set1, two));
+
+		uint8_t *out = indices + stride * (4 * half);
+		if (stride == 8) {
+			_mm256_storeu_si256(reinterpret_cast< __m256i * >(out), idx);
+		} else {
+			alignas(32) uint8_t rows[32];
+			_mm256_store_si256(reinterpret_cast< __m256i * >(rows), idx);
+			for (uint32_t y = 0; y < 4; ++y) {
+				std::memcpy(out + stride * y, rows + 8 * y, 8);
+			}
+		}
+	}
+#elif defined(DECODE_TILE_SSE2)
+	//load the eight row bytes of each plane:
+	const __m128i plane0 = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(tile.bit0.data()));
+	const __m128i plane1 = _mm_loadl_epi64(reinterpret_cast< __m128i const * >(tile.bit1.data()));
+
+	//expand the row bytes so that each is repeated eight times; the result is two rows per register:
+	auto spread_rows = [](__m128i plane, __m128i rows[4]) {
+		__m128i twice = _mm_unpacklo_epi8(plane, plane); //r0 r0 r1 r1 ... r7 r7
+		__m128i lo = _mm_unpacklo_epi16(twice, twice); //r0 x4 .. r3 x4
+		__m128i hi = _mm_unpackhi_epi16(twice, twice); //r4 x4 .. r7 x4
+		rows[0] = _mm_unpacklo_epi32(lo, lo); //r0 x8, r1 x8
+		rows[1] = _mm_unpackhi_epi32(lo, lo); //r2 x8, r3 x8
+		rows[2] = _mm_unpacklo_epi32(hi, hi); //r4 x8, r5 x8
+		rows[3] = _mm_unpackhi_epi32(hi, hi); //r6 x8, r7 x8
+	};
+	__m128i rows0[4], rows1[4];
+	spread_rows(plane0, rows0);
+	spread_rows(plane1, rows1);
+
+	//pixel x of each row tests bit x:
+	const __m128i bit = _mm_set_epi8(-128,64,32,16,8,4,2,1, -128,64,32,16,8,4,2,1);
+	const __m128i one = _mm_set1_epi8(1);
+	const __m128i two = _mm_set1_epi8(2);
+
+	for (uint32_t pair = 0; pair < 4; ++pair) {
+		__m128i set0 = _mm_cmpeq_epi8(_mm_and_si128(rows0[pair], bit), bit);
+		__m128i set1 = _mm_cmpeq_epi8(_mm_and_si128(rows1[pair], bit), bit);
+		__m128i idx = _mm_or_si128(_mm_and_si128(set0, one), _mm_and_si128(set1, two));
+
+		uint8_t *out = indices + stride * (2 * pair);
+		if (stride == 8) {
+			_mm_storeu_si128(reinterpret_cast< __m128i * >(out), idx);
+		} else {
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(out), idx);
+			_mm_storel_epi64(reinterpret_cast< __m128i * >(out + stride), _mm_srli_si128(idx, 8));
+		}
+	}
+#else
+	for (uint32_t y = 0; y < 8; ++y) {
+		decode_tile_row(tile.bit0[y], tile.bit1[y], indices + stride * y);
+	}
+#endif
+}
+
+void decode_tile_row_scalar(uint8_t bit0, uint8_t bit1, uint8_t *indices) {
+	for (uint32_t x = 0; x < 8; ++x) {
+		indices[x] =
+			  ((bit0 >> x) & 1)
+			| ((bit1 >> x) & 1) << 1;
+	}
+}
+
+void decode_tile_scalar(PPU466::Tile const &tile, uint8_t *indices, uint32_t stride) {
+	for (uint32_t y = 0; y < 8; ++y) {
+		decode_tile_row_scalar(tile.bit0[y], tile.bit1[y], indices + stride * y);
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "PPU466.hpp"
+
+#include <cstdint>
+
+/*
+ * Expand PPU466 tile bit planes into per-pixel 2-bit color indices:
+ *   index of pixel x in a row = ((bit1 >> x) & 1) << 1 | ((bit0 >> x) & 1)
+ *
+ * Whole tiles are decoded with SSE2 (or AVX2, if compiled with it) when available;
+ *  otherwise (and for single rows) a branch-free 64-bit "SIMD within a register" version is used.
+ *
+ * Useful anywhere tiles need to be turned back into pixels (PPU466 texture uploads, software rendering, tools).
+ */
+
+//decode one row of a tile into 8 indices:
+void decode_tile_row(uint8_t bit0, uint8_t bit1, uint8_t *indices);
+
+//decode a whole tile into 8 rows of 8 indices, with rows 'stride' bytes apart:
+// (rows are stored in the same bottom-to-top order as the tile's bit planes)
+void decode_tile(PPU466::Tile const &tile, uint8_t *indices, uint32_t stride = 8);
+
+//straightforward per-pixel versions of the above, for reference and testing:
+void decode_tile_row_scalar(uint8_t bit0, uint8_t bit1, uint8_t *indices);
+void decode_tile_scalar(PPU466::Tile const &tile, uint8_t *indices, uint32_t stride = 8);
@@ -13,12 +13,25 @@
 //for screenshots:
 #include "load_save_png.hpp"
 
+//for running the simulation at a fixed rate (optionally on its own thread):
+#include "FixedTimestep.hpp"
+#include "SimulationThread.hpp"
+
+//for recording and replaying input:
+#include "InputLog.hpp"
+
+//for timing the main loop:
+#include "FrameProfiler.hpp"
+#include "FrameProfilerOverlay.hpp"
+
 //Includes for libSDL:
 #include <SDL3/SDL.h>
 #include <SDL3/SDL_main.h>
 
 //...and for c++ standard library functions:
 #include <chrono>
+#include <cmath>
+#include <cstdlib>
 #include <iostream>
 #include <stdexcept>
 #include <memory>
@@ -43,6 +56,57 @@ int main(int argc, char **argv) {
 	try {
 #endif
 
+	//------------  command line ------------
+
+	float sim_hz = 120.0f; //simulation steps per second
+	uint32_t max_sim_steps = 8; //most simulation steps to run per frame (beyond this, the game slows down)
+	bool threaded_sim = false; //run event handling + updates on their own thread
+	std::string record_file; //if set, save the events given to the mode to this file
+	std::string replay_file; //if set, replay events from this file (as fast as possible) instead of using live input
+
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--sim-hz" && argi + 1 < argc) {
+			sim_hz = std::strtof(argv[++argi], nullptr);
+			if (!(sim_hz > 0.0f)) {
+				std::cerr << "Expected a positive number after --sim-hz." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--max-sim-steps" && argi + 1 < argc) {
+			max_sim_steps = uint32_t(std::strtoul(argv[++argi], nullptr, 10));
+			if (max_sim_steps == 0) {
+				std::cerr << "Expected a positive integer after --max-sim-steps." << std::endl;
+				return 1;
+			}
+		} else if (arg == "--threaded-sim") {
+			threaded_sim = true;
+		} else if (arg == "--record" && argi + 1 < argc) {
+			record_file = argv[++argi];
+		} else if (arg == "--replay" && argi + 1 < argc) {
+			replay_file = argv[++argi];
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--sim-hz <hz>] [--max-sim-steps <n>] [--threaded-sim] [--record <file> | --replay <file>]" << std::endl;
+			return 1;
+		}
+	}
+	if (!record_file.empty() && !replay_file.empty()) {
+		std::cerr << "Can't --record and --replay at the same time." << std::endl;
+		return 1;
+	}
+	if (threaded_sim && !(record_file.empty() && replay_file.empty())) {
+		std::cerr << "Recording and replaying need the simulation on the main thread (leave out --threaded-sim)." << std::endl;
+		return 1;
+	}
+
+	//load the replay up front (so a bad file is noticed before opening a window):
+	InputLog replay;
+	if (!replay_file.empty()) {
+		replay.load(replay_file);
+		//replays must use the step length they were recorded with:
+		sim_hz = 1.0f / replay.info.step;
+		std::cout << "Replaying " << replay.events.size() << " events over " << replay.info.steps << " steps from '" << replay_file << "'." << std::endl;
+	}
+
 	//------------  initialization ------------
 
 	//Initialize SDL library:
@@ -92,7 +156,10 @@ int main(int argc, char **argv) {
 	init_GL();
 
 	//Set VSYNC + Late Swap (prevents crazy FPS):
-	if (!SDL_GL_SetSwapInterval(-1)) {
+	if (!replay_file.empty()) {
+		//...except when replaying, which should go as fast as possible:
+		SDL_GL_SetSwapInterval(0);
+	} else if (!SDL_GL_SetSwapInterval(-1)) {
 		std::cerr << "NOTE: couldn't set vsync + late swap tearing (" << SDL_GetError() << ")." << std::endl;
 		if (!SDL_GL_SetSwapInterval(1)) { // 0 = ASAP, 1 = wait for the next vertical link, -1 = adaptive vsync
 			std::cerr << "NOTE: couldn't set vsync (" << SDL_GetError() << ")." << std::endl;
@@ -125,12 +192,84 @@ int main(int argc, char **argv) {
 	};
 	on_resize();
 
+	//record timing for every frame; F3 shows a frame-time graph, F4 saves a trace:
+	FrameProfiler profiler;
+	FrameProfilerOverlay profiler_overlay;
+	bool show_profiler = false;
+
+	//Mode::update is called at a fixed rate:
+	FixedTimestep timestep(sim_hz, max_sim_steps);
+	uint64_t reported_drops = 0;
+	auto last_drop_report = std::chrono::high_resolution_clock::now();
+
+	uint64_t steps_run = 0; //(when updating on this thread)
+
+	//events given to the mode can be recorded:
+	InputLog record;
+	record.info.step = timestep.step;
+
+	//...or replayed, in which case each frame runs as many steps as it would at 60 frames per second:
+	size_t replay_event = 0;
+	uint32_t replay_steps_per_frame = std::max(1U, uint32_t(std::round(sim_hz / 60.0f)));
+	auto replay_start = std::chrono::high_resolution_clock::now();
+	uint64_t replay_frames = 0;
+
+	//...possibly on a thread of its own (in which case this thread just draws snapshots):
+	std::unique_ptr< SimulationThread > sim;
+	if (threaded_sim) {
+		sim = std::make_unique< SimulationThread >(timestep);
+	}
+
+	//keys handled by the main loop itself; returns true if it handled the event:
+	auto handle_loop_event = [&](SDL_Event const &evt) {
+		if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_PRINTSCREEN) {
+			// --- screenshot key ---
+			std::string filename = "screenshot.png";
+			std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
+			glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+			glReadBuffer(GL_FRONT);
+			int w,h;
+			SDL_GetWindowSizeInPixels(Mode::window, &w, &h);
+			std::vector< glm::u8vec4 > data(w*h);
+			glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
+			for (auto &px : data) {
+				px.a = 0xff;
+			}
+			save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+			return true;
+		} else if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_F3) {
+			show_profiler = !show_profiler;
+			return true;
+		} else if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_F4) {
+			std::string filename = "frame-trace.json";
+			if (profiler.write_trace(filename)) {
+				std::cout << "Wrote frame trace to '" << filename << "'." << std::endl;
+			} else {
+				std::cerr << "Failed to write frame trace to '" << filename << "'." << std::endl;
+			}
+			return true;
+		}
+		return false;
+	};
+
+	//pass an event to the mode (recording it, if asked to):
+	auto give_to_mode = [&](SDL_Event const &evt) {
+		if (!record_file.empty()) {
+			record.events.emplace_back(InputLog::from_sdl(evt, window_size, uint32_t(steps_run)));
+		}
+		return Mode::current->handle_event(evt, window_size);
+	};
+
 	//This will loop until the current mode is set to null:
-	while (Mode::current) {
+	// (while the simulation thread is running, it owns Mode::current -- so don't look at it)
+	while (sim || Mode::current) {
+		profiler.begin_frame();
+
 		//every pass through the game loop creates one frame of output
 		//  by performing three steps:
 
 		{ //(1) process any events that are pending
+			FrameProfiler::Scope scope(profiler, FrameProfiler::Events);
 			static SDL_Event evt;
 			while (SDL_PollEvent(&evt)) {
 				//handle resizing:
@@ -138,54 +277,130 @@ int main(int argc, char **argv) {
 					on_resize();
 				}
 				//handle input:
-				if (Mode::current && Mode::current->handle_event(evt, window_size)) {
+				if (sim) {
+					//the mode's handle_event runs later, on the simulation thread, so the main loop gets first pick:
+					if (evt.type == SDL_EVENT_QUIT) {
+						sim.reset();
+						Mode::set_current(nullptr);
+						break;
+					} else if (!handle_loop_event(evt)) {
+						sim->push_event(evt, window_size);
+					}
+				} else if (!replay_file.empty()) {
+					//live input doesn't go to the mode during a replay:
+					if (evt.type == SDL_EVENT_QUIT) {
+						Mode::set_current(nullptr);
+						break;
+					}
+					handle_loop_event(evt);
+				} else if (Mode::current && give_to_mode(evt)) {
 					// mode handled it; great
 				} else if (evt.type == SDL_EVENT_QUIT) {
 					Mode::set_current(nullptr);
 					break;
-				} else if (evt.type == SDL_EVENT_KEY_DOWN && evt.key.key == SDLK_PRINTSCREEN) {
-					// --- screenshot key ---
-					std::string filename = "screenshot.png";
-					std::cout << "Saving screenshot to '" << filename << "'." << std::endl;
-					glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
-					glReadBuffer(GL_FRONT);
-					int w,h;
-					SDL_GetWindowSizeInPixels(Mode::window, &w, &h);
-					std::vector< glm::u8vec4 > data(w*h);
-					glReadPixels(0,0,w,h, GL_RGBA, GL_UNSIGNED_BYTE, data.data());
-					for (auto &px : data) {
-						px.a = 0xff;
-					}
-					save_png(filename, glm::uvec2(w,h), data.data(), LowerLeftOrigin);
+				} else {
+					handle_loop_event(evt);
 				}
 			}
-			if (!Mode::current) break;
+			if (!sim && !Mode::current) break;
 		}
 
-		{ //(2) call the current mode's "update" function to deal with elapsed time:
+		{ //(2) call the current mode's "update" function once per fixed step of elapsed time:
+			FrameProfiler::Scope scope(profiler, FrameProfiler::Update);
+
+			if (sim && sim->finished()) {
+				//mode was set to null on the simulation thread:
+				sim.reset();
+				break;
+			}
+			if (sim && sim->unsupported()) {
+				std::cerr << "NOTE: mode can't be drawn from snapshots, so not using a simulation thread." << std::endl;
+				sim.reset();
+			}
+
 			auto current_time = std::chrono::high_resolution_clock::now();
 			static auto previous_time = current_time; // static in this context prevents re-initialization
 			float elapsed = std::chrono::duration< float >(current_time - previous_time).count();
 			previous_time = current_time;
 
-			//if frames are taking a very long time to process,
-			//lag to avoid spiral of death:
-			elapsed = std::min(0.1f, elapsed); // aka, just lie lol
+			if (!sim && !replay_file.empty()) {
+				//feed recorded events to the mode before the steps they arrived before:
+				for (uint32_t s = 0; s < replay_steps_per_frame && Mode::current; ++s) {
+					while (replay_event < replay.events.size() && replay.events[replay_event].step == steps_run && Mode::current) {
+						InputLog::Event const &event = replay.events[replay_event];
+						Mode::current->handle_event(InputLog::to_sdl(event), glm::uvec2(event.window_size));
+						replay_event += 1;
+					}
+					if (steps_run == replay.info.steps) {
+						//out of input, so report how long the replay took and stop:
+						float seconds = std::chrono::duration< float >(current_time - replay_start).count();
+						std::cout << "Replayed " << steps_run << " steps (" << steps_run * timestep.step << " seconds of play) in " << replay_frames << " frames and " << seconds << " seconds." << std::endl;
+						Mode::set_current(nullptr);
+						break;
+					}
+					Mode::current->update(timestep.step);
+					steps_run += 1;
+				}
+				replay_frames += 1;
+			} else if (!sim) {
+				//if frames are taking a very long time to process, the timestep
+				//drops steps beyond max_sim_steps to avoid spiral of death:
+				uint32_t steps = timestep.advance(elapsed);
+				for (uint32_t s = 0; s < steps && Mode::current; ++s) {
+					Mode::current->update(timestep.step);
+					steps_run += 1;
+				}
+			}
+
+			//mention dropped steps (but not more than once a second):
+			uint64_t drops = (sim ? sim->steps_dropped.load() : timestep.steps_dropped);
+			if (drops > reported_drops && current_time - last_drop_report > std::chrono::seconds(1)) {
+				std::cerr << "NOTE: simulation fell behind; dropped " << drops << " steps so far." << std::endl;
+				reported_drops = drops;
+				last_drop_report = current_time;
+			}
 
-			Mode::current->update(elapsed);
-			if (!Mode::current) break;
+			if (!sim && !Mode::current) break;
 		}
 
 		{ //(3) call the current mode's "draw" function to produce output:
-		
-			Mode::current->draw(drawable_size);
+			FrameProfiler::Scope scope(profiler, FrameProfiler::Draw);
+			if (sim) {
+				//draw the latest state the simulation thread has finished (with sprites moved between it and the one before):
+				if (PPU466 const *snapshot = sim->interpolated_snapshot()) {
+					snapshot->draw(drawable_size);
+				} else {
+					glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
+					glClear(GL_COLOR_BUFFER_BIT);
+				}
+			} else {
+				Mode::current->draw(drawable_size, timestep.alpha());
+			}
 		}
 
-		//Wait until the recently-drawn frame is shown before doing it all again:
-		SDL_GL_SwapWindow(Mode::window);
+		if (show_profiler) {
+			profiler_overlay.draw(profiler, drawable_size);
+		}
+
+		{ //Wait until the recently-drawn frame is shown before doing it all again:
+			FrameProfiler::Scope scope(profiler, FrameProfiler::Swap);
+			SDL_GL_SwapWindow(Mode::window);
+		}
+
+		profiler.end_frame();
 	}
 
 
+	if (!record_file.empty()) {
+		record.info.steps = uint32_t(steps_run);
+		try {
+			record.save(record_file);
+			std::cout << "Recorded " << record.events.size() << " events over " << steps_run << " steps to '" << record_file << "'." << std::endl;
+		} catch (std::exception const &e) {
+			std::cerr << e.what() << std::endl;
+		}
+	}
+
 	//------------  teardown ------------
 
 	SDL_GL_DestroyContext(context);
@@ -0,0 +1,95 @@
+//Packs files into a single AssetPack (see AssetPack.hpp), so the game opens one file instead of many.
+//Built and run by Maekfile.js; to run by hand:
+//$ dist/pack-assets dist/assets.pack spritesheet.tiles=dist/spritesheet.tiles [name=file ...]
+
+#include "AssetPack.hpp"
+#include "read_write_chunk.hpp"
+
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+int main(int argc, char **argv) {
+	if (argc < 2) {
+		std::cerr << "Usage:\n\t" << argv[0] << " <out.pack> [name=file ...]" << std::endl;
+		return 1;
+	}
+	std::string out_pack = argv[1];
+
+	try {
+		//read all the files and names:
+		std::vector< AssetPack::Entry > entries;
+		std::vector< char > names;
+		std::vector< std::vector< char > > contents;
+		std::unordered_set< std::string > seen;
+
+		for (int argi = 2; argi < argc; ++argi) {
+			std::string arg = argv[argi];
+			auto eq = arg.find('=');
+			if (eq == std::string::npos || eq == 0) {
+				throw std::runtime_error("Expected 'name=file', got '" + arg + "'.");
+			}
+			std::string name = arg.substr(0, eq);
+			std::string filename = arg.substr(eq + 1);
+			if (!seen.emplace(name).second) {
+				throw std::runtime_error("Asset '" + name + "' is listed more than once.");
+			}
+
+			std::ifstream file(filename, std::ios::binary);
+			if (!file) {
+				throw std::runtime_error("Failed to open '" + filename + "'.");
+			}
+			contents.emplace_back(std::istreambuf_iterator< char >(file), std::istreambuf_iterator< char >());
+			if (contents.back().size() > 0xffffffffULL) {
+				throw std::runtime_error("'" + filename + "' is too large to pack.");
+			}
+
+			AssetPack::Entry entry;
+			entry.name_begin = uint32_t(names.size());
+			names.insert(names.end(), name.begin(), name.end());
+			entry.name_end = uint32_t(names.size());
+			entry.size = uint32_t(contents.back().size());
+			entries.emplace_back(entry);
+		}
+
+		//lay out the file (the index comes first, so offsets can be computed before writing anything):
+		constexpr uint64_t HeaderSize = 8; //(chunk header: magic + size)
+		uint64_t at = HeaderSize + entries.size() * sizeof(AssetPack::Entry) + HeaderSize + names.size();
+		std::vector< uint32_t > padding(entries.size(), 0);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			//pad (with a "pad0" chunk, which is at least a header) until the contents start on an aligned offset:
+			if ((at + HeaderSize) % AssetPack::Alignment != 0) {
+				uint64_t start = at + HeaderSize + HeaderSize; //(after pad header and data header)
+				padding[i] = uint32_t((AssetPack::Alignment - start % AssetPack::Alignment) % AssetPack::Alignment);
+				at += HeaderSize + padding[i];
+			}
+			entries[i].offset = at + HeaderSize;
+			at += HeaderSize + entries[i].size;
+		}
+
+		//write it:
+		std::ofstream out(out_pack, std::ios::binary);
+		write_chunk("idx0", entries, &out);
+		write_chunk("str0", names, &out);
+		for (size_t i = 0; i < entries.size(); ++i) {
+			if (uint64_t(out.tellp()) + HeaderSize != entries[i].offset) {
+				write_chunk("pad0", std::vector< char >(padding[i], '\0'), &out);
+			}
+			write_chunk("dat0", contents[i], &out);
+		}
+		if (!out || uint64_t(out.tellp()) != at) {
+			throw std::runtime_error("Failed to write '" + out_pack + "'.");
+		}
+
+		std::cout << "Packed " << entries.size() << " assets (" << at << " bytes) into '" << out_pack << "'." << std::endl;
+	} catch (std::exception const &e) {
+		std::cerr << "ERROR: " << e.what() << std::endl;
+		return 1;
+	}
+
+	return 0;
+}
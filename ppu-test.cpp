@@ -0,0 +1,248 @@
+//Checks for PPU466's software renderer and sprite helpers:
+// - renders a fixed PPU state and compares it to a checked-in image (test/ppu466-golden.png)
+// - renders random PPU states with PPURenderPool (at several thread counts) and compares them to render()
+// - runs SpriteMultiplexer with more sprites than slots and checks which sprites get shown
+//Build with:
+//$ node Maekfile.js dist/ppu-test
+//Run with:
+//$ dist/ppu-test [--update]
+// (--update rewrites the checked-in image from the current renderer -- only do this for intended changes)
+
+#include "PPU466.hpp"
+#include "PPURenderPool.hpp"
+#include "SpriteMultiplexer.hpp"
+#include "load_save_png.hpp"
+#include "data_path.hpp"
+
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace {
+	//a PPU state that exercises everything render() does:
+	// (uses raw mt19937 outputs, which -- unlike std::uniform_*_distribution -- are the same on every platform)
+	PPU466 make_test_ppu(uint32_t seed) {
+		PPU466 ppu;
+		std::mt19937 mt(seed);
+
+		ppu.background_color = glm::u8vec3(0x20, 0x18, 0x30);
+
+		for (auto &tile : ppu.tile_table) {
+			for (uint32_t y = 0; y < 8; ++y) {
+				tile.bit0[y] = uint8_t(mt());
+				tile.bit1[y] = uint8_t(mt());
+			}
+		}
+
+		//palettes mix transparent, semi-transparent, and opaque colors:
+		for (auto &palette : ppu.palette_table) {
+			for (auto &color : palette) {
+				uint32_t bits = mt();
+				color = glm::u8vec4(bits, bits >> 8, bits >> 16, 0xff);
+				if ((bits >> 24) % 4 == 0) color.a = 0x00;
+				else if ((bits >> 24) % 4 == 1) color.a = uint8_t(bits >> 26);
+			}
+		}
+
+		for (auto &entry : ppu.background) {
+			entry = uint16_t(mt() & 0x07ff);
+		}
+		//scrolled so the background wraps in both directions:
+		ppu.background_position = glm::ivec2(-173, 301);
+
+		//more sprites than fit on some lines, in front of and behind the background:
+		for (auto &sprite : ppu.sprites) {
+			uint32_t bits = mt();
+			sprite.x = uint8_t(bits);
+			sprite.y = uint8_t(((bits >> 8) & 0xff) % 250);
+			sprite.index = uint8_t(bits >> 16);
+			sprite.attributes = uint8_t(((bits >> 24) & 0x07) | ((bits >> 24) & 0x80));
+		}
+		//a crowd on scanlines 100-107 so the per-line limit matters:
+		for (uint32_t i = 0; i < 12; ++i) {
+			ppu.sprites[i].x = uint8_t(20 * i);
+			ppu.sprites[i].y = 100;
+		}
+		ppu.limit_sprites_per_line = true;
+
+		return ppu;
+	}
+
+	bool check_golden(bool update) {
+		std::string golden_path = data_path("../test/ppu466-golden.png");
+
+		PPU466 ppu = make_test_ppu(0x466);
+		std::vector< glm::u8vec4 > pixels(PPU466::ScreenWidth * PPU466::ScreenHeight);
+		ppu.render(pixels.data());
+
+		if (update) {
+			save_png(golden_path, glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight), pixels.data(), LowerLeftOrigin);
+			std::cout << "Wrote '" << golden_path << "'." << std::endl;
+			return true;
+		}
+
+		glm::uvec2 size;
+		std::vector< glm::u8vec4 > golden;
+		load_png(golden_path, &size, &golden, LowerLeftOrigin);
+		if (size != glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight)) {
+			std::cerr << "ERROR: '" << golden_path << "' is " << size.x << "x" << size.y << ", expected " << PPU466::ScreenWidth << "x" << PPU466::ScreenHeight << "." << std::endl;
+			return false;
+		}
+
+		uint32_t mismatched = 0;
+		for (uint32_t i = 0; i < pixels.size(); ++i) {
+			if (pixels[i] != golden[i]) {
+				if (mismatched == 0) {
+					std::cerr << "ERROR: first mismatch at pixel (" << i % PPU466::ScreenWidth << ", " << i / PPU466::ScreenWidth << ")." << std::endl;
+				}
+				++mismatched;
+			}
+		}
+		if (mismatched != 0) {
+			std::string actual_path = data_path("ppu466-actual.png");
+			save_png(actual_path, glm::uvec2(PPU466::ScreenWidth, PPU466::ScreenHeight), pixels.data(), LowerLeftOrigin);
+			std::cerr << "ERROR: render() differs from '" << golden_path << "' in " << mismatched << " pixels (wrote '" << actual_path << "')." << std::endl;
+			return false;
+		}
+
+		std::cout << "render() matches '" << golden_path << "'." << std::endl;
+		return true;
+	}
+
+	bool check_render_pool() {
+		constexpr uint32_t States = 50;
+		std::vector< glm::u8vec4 > expected(PPU466::ScreenWidth * PPU466::ScreenHeight);
+		std::vector< glm::u8vec4 > pixels(PPU466::ScreenWidth * PPU466::ScreenHeight);
+
+		//(thread counts are workers, not counting the caller; includes more threads than bands of work to hand out)
+		for (uint32_t threads : {1U, 2U, 3U, 7U, uint32_t(PPURenderPool::BandCount) + 2U}) {
+			PPURenderPool pool(threads);
+			std::mt19937 mt(threads);
+			for (uint32_t s = 0; s < States; ++s) {
+				PPU466 ppu = make_test_ppu(mt());
+				ppu.background_position = glm::ivec2(int32_t(mt() % 2048) - 1024, int32_t(mt() % 2048) - 1024);
+				ppu.limit_sprites_per_line = (mt() % 2 == 0);
+
+				ppu.render(expected.data());
+				//(start from garbage, so rows the pool misses are caught)
+				for (auto &px : pixels) px = glm::u8vec4(uint8_t(mt()));
+				pool.render(ppu, pixels.data());
+
+				if (pixels != expected) {
+					std::cerr << "ERROR: PPURenderPool with " << threads << " worker threads differs from render() on state " << s << "." << std::endl;
+					return false;
+				}
+			}
+		}
+
+		std::cout << "PPURenderPool matches render() on " << States << " random states at each thread count." << std::endl;
+		return true;
+	}
+
+	bool check_sprite_multiplexer() {
+		//more sprites than slots: 10 at high priority (always fit), 100 at middle priority (54 slots left), 30 at low priority (never fit):
+		constexpr uint32_t High = 10, Middle = 100, Low = 30;
+		constexpr uint32_t Frames = 100;
+		constexpr uint32_t Slots = 64;
+		constexpr uint32_t MiddleSlots = Slots - High;
+
+		//the sprite with id 'id' uses tile 'id', so which sprite is in a slot can be read back:
+		auto priority_of = [](uint32_t id) -> uint8_t {
+			return (id < High ? 2 : (id < High + Middle ? 1 : 0));
+		};
+		auto fill = [&](SpriteMultiplexer &multiplexer) {
+			multiplexer.clear();
+			//(set in reverse order, so slot order can't just be the order of set() calls)
+			for (uint32_t id = High + Middle + Low; id > 0; --id) {
+				PPU466::Sprite sprite;
+				sprite.x = uint8_t(id - 1);
+				sprite.y = 100;
+				sprite.index = uint8_t(id - 1);
+				multiplexer.set(id - 1, sprite, priority_of(id - 1));
+			}
+		};
+
+		SpriteMultiplexer multiplexer(High + Middle + Low);
+		SpriteMultiplexer again(High + Middle + Low); //same input, to check the result is deterministic
+		PPU466 ppu, ppu_again;
+
+		for (uint32_t frame = 0; frame < Frames; ++frame) {
+			fill(multiplexer);
+			multiplexer.assign(&ppu);
+			fill(again);
+			again.assign(&ppu_again);
+
+			for (uint32_t slot = 0; slot < Slots; ++slot) {
+				if (ppu.sprites[slot].index != ppu_again.sprites[slot].index) {
+					std::cerr << "ERROR: SpriteMultiplexer assigned different sprites to slot " << slot << " from the same input on frame " << frame << "." << std::endl;
+					return false;
+				}
+				//slots are filled in priority order:
+				uint8_t expected = (slot < High ? 2 : 1);
+				if (priority_of(ppu.sprites[slot].index) != expected) {
+					std::cerr << "ERROR: SpriteMultiplexer put a priority " << int(priority_of(ppu.sprites[slot].index)) << " sprite in slot " << slot << " on frame " << frame << " (expected priority " << int(expected) << ")." << std::endl;
+					return false;
+				}
+			}
+			if (multiplexer.last_visible != High + Middle + Low || multiplexer.last_dropped != High + Middle + Low - Slots) {
+				std::cerr << "ERROR: SpriteMultiplexer reported " << multiplexer.last_visible << " visible / " << multiplexer.last_dropped << " dropped on frame " << frame << "." << std::endl;
+				return false;
+			}
+		}
+
+		//high priority sprites are always shown, low priority never, and middle priority sprites share their slots evenly:
+		for (uint32_t id = 0; id < High + Middle + Low; ++id) {
+			uint32_t expected_shown = 0;
+			if (priority_of(id) == 2) expected_shown = Frames;
+			else if (priority_of(id) == 1) expected_shown = Frames * MiddleSlots / Middle;
+			SpriteMultiplexer::SpriteStats const &stats = multiplexer.stats(id);
+			if (stats.shown != expected_shown || stats.dropped != Frames - expected_shown) {
+				std::cerr << "ERROR: SpriteMultiplexer showed sprite " << id << " (priority " << int(priority_of(id)) << ") " << stats.shown << " times and dropped it " << stats.dropped << " times over " << Frames << " frames (expected " << expected_shown << " and " << Frames - expected_shown << ")." << std::endl;
+				return false;
+			}
+		}
+
+		//a multiplexer using only some of the slots leaves the others alone:
+		{
+			PPU466 shared;
+			for (uint32_t slot = 0; slot < Slots; ++slot) shared.sprites[slot].index = 0xff;
+			SpriteMultiplexer upper(High + Middle + Low, 32, 32);
+			fill(upper);
+			upper.assign(&shared);
+			bool below_untouched = std::all_of(shared.sprites.begin(), shared.sprites.begin() + 32, [](PPU466::Sprite const &sprite){ return sprite.index == 0xff; });
+			bool above_used = std::all_of(shared.sprites.begin() + 32, shared.sprites.end(), [](PPU466::Sprite const &sprite){ return sprite.index != 0xff; });
+			if (!below_untouched || !above_used || upper.last_dropped != High + Middle + Low - 32) {
+				std::cerr << "ERROR: SpriteMultiplexer with slots [32,64) didn't stay within its slots." << std::endl;
+				return false;
+			}
+		}
+
+		std::cout << "SpriteMultiplexer shares " << MiddleSlots << " slots among " << Middle << " sprites evenly over " << Frames << " frames." << std::endl;
+		return true;
+	}
+}
+
+int main(int argc, char **argv) {
+	bool update = false;
+	for (int argi = 1; argi < argc; ++argi) {
+		std::string arg = argv[argi];
+		if (arg == "--update") {
+			update = true;
+		} else {
+			std::cerr << "Usage:\n\t" << argv[0] << " [--update]" << std::endl;
+			return 1;
+		}
+	}
+
+	bool ok = true;
+	ok = check_golden(update) && ok;
+	ok = check_render_pool() && ok;
+	ok = check_sprite_multiplexer() && ok;
+
+	if (!ok) return 1;
+	std::cout << "All checks passed." << std::endl;
+	return 0;
+}
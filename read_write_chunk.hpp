@@ -2,8 +2,12 @@
 
 #include <iostream>
 #include <vector>
+#include <span>
 #include <stdexcept>
 #include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
 
 //helper function that reads an array of structures preceded by a simple header:
 //Expected format:
@@ -63,3 +67,50 @@ void write_chunk(std::string const &magic, std::vector< T > const &from, std::os
 	to.write(reinterpret_cast< const char * >(&header), sizeof(header));
 	to.write(reinterpret_cast< const char * >(from.data()), from.size() * sizeof(T));
 }
+
+
+//helper function that reads a chunk (in the same format as read_chunk) directly out of memory -- e.g., a MappedFile -- without copying it:
+// 'from' is advanced past the chunk; 'to' points into the memory 'from' pointed to, so stays valid only as long as that memory does.
+template< typename T >
+void map_chunk(std::span< char const > *from_, std::string const &magic, std::span< T const > *to_) {
+	static_assert(std::is_trivially_copyable_v< T >, "chunks hold plain data");
+	assert(from_);
+	assert(to_);
+	auto &from = *from_;
+	auto &to = *to_;
+
+	struct ChunkHeader {
+		char magic[4] = {'\0', '\0', '\0', '\0'};
+		uint32_t size = 0;
+	};
+	static_assert(sizeof(ChunkHeader) == 8, "header is packed");
+
+	ChunkHeader header;
+	if (from.size() < sizeof(header)) {
+		throw std::runtime_error("Failed to read chunk header");
+	}
+	std::memcpy(&header, from.data(), sizeof(header));
+	if (std::string(header.magic,4) != magic) {
+		throw std::runtime_error("Unexpected magic number in chunk");
+	}
+
+	std::span< char const > data = from.subspan(sizeof(header));
+	if (header.size > data.size()) {
+		//chunks are written in native endian order, so a size that only fits once swapped means the file came from a machine with the other byte order:
+		uint32_t swapped = ((header.size & 0xff) << 24) | ((header.size & 0xff00) << 8) | ((header.size >> 8) & 0xff00) | (header.size >> 24);
+		if (swapped <= data.size()) {
+			throw std::runtime_error("Chunk size is byte-swapped (written on a machine with different endianness?)");
+		}
+		throw std::runtime_error("Failed to read chunk data.");
+	}
+
+	if (header.size % sizeof(T) != 0) {
+		throw std::runtime_error("Size of chunk not divisible by element size");
+	}
+	if (reinterpret_cast< uintptr_t >(data.data()) % alignof(T) != 0) {
+		throw std::runtime_error("Chunk data is not aligned for its element type");
+	}
+
+	to = std::span< T const >(reinterpret_cast< T const * >(data.data()), header.size / sizeof(T));
+	from = data.subspan(header.size);
+}